@@ -13,6 +13,11 @@
 #include "Arduino.h"
 #include "SixteenStep.h"
 
+// spare note buffers shared by all the sequencers
+SixteenStepNote* SixteenStep::_spares[FS_SPARE_BUFFERS];
+volatile int SixteenStep::_spare_count = 0;
+int SixteenStep::_spare_size = 0;
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 //                            CONSTRUCTORS                                   //
@@ -166,6 +171,70 @@ void SixteenStep::step()
 
 }
 
+// tick
+//
+// Clocks the sequencer from an external tick source instead of
+// millis(). Call this setTicksPerStep() times per step.
+// The groove moves each step by a number of ticks - the groove
+// steps are counted from start() rather than from the step position
+// so tracks with odd lengths don't drift against each other and
+// every loop grooves the same. setShuffle() is not used in this mode.
+// Can be called from an interrupt.
+//
+// @access public
+// @return void
+//
+void SixteenStep::tick()
+{
+
+  if(! _running)
+    return;
+
+  // repeats of notes that already started
+  if(_active_ratchets)
+    _runRatchets();
+
+  // only step at the end of the current step
+  // in between play any notes that are offset from the start of the step
+  if(++_tick_count < _tick_length)
+  {
+    if(_late_notes)
+      _triggerLateNotes();
+    return;
+  }
+
+  _tick_count = 0;
+  _groove_step = _groove_length > 0 ? _stepcount % _groove_length : 0;
+
+  // advance and send notes
+  _step();
+
+  // the step lasts until the groove position of the next one
+  // the first step can't be early so it starts on the grid
+  int now = _grooveOffset(_stepcount);
+  if(_stepcount == 0)
+    now = max(0, now);
+  _tick_length = _ticks_per_step + _grooveOffset(_stepcount + 1) - now;
+  if(_tick_length < 1)
+    _tick_length = 1;
+  ++_stepcount;
+
+}
+
+// setTicksPerStep
+//
+// Sets the number of tick() calls per 16th note step
+// when the sequencer is clocked externally
+//
+// @access public
+// @param ticks per step
+// @return void
+//
+void SixteenStep::setTicksPerStep(int ticks)
+{
+  _ticks_per_step = ticks;
+}
+
 // setTempo
 //
 // Allows user to dynamiclly set the tempo in
@@ -224,6 +293,8 @@ void SixteenStep::setTempo(int tempo)
 void SixteenStep::setSteps(int steps)
 {
 
+  _changed();
+
   // set new step value
   _steps = steps;
 
@@ -321,7 +392,8 @@ void SixteenStep::decreaseShuffle()
 
 // setShuffle - added by RH
 //
-// Allows user to set the shuffle amount
+// Allows user to set the shuffle amount when clocked by run().
+// Use setGroove() when clocked with tick().
 //
 // @access public
 // @return void
@@ -329,7 +401,7 @@ void SixteenStep::decreaseShuffle()
 void SixteenStep::setShuffle(int divisions)
 {
 
-  constrain (divisions,0,15); // limit values to usable range
+  divisions = constrain (divisions,0,15); // limit values to usable range
   // grab current shuffle division
   unsigned long div = _shuffleDivision();
 
@@ -338,6 +410,31 @@ void SixteenStep::setShuffle(int divisions)
 
 }
 
+// setGroove
+//
+// Sets the groove used when clocked with tick(). Step n of the
+// groove is played timing[n] 24ths of a step early (negative) or
+// late and has velocity[n] added to its notes. The groove repeats
+// every length steps counted from start(). The arrays are not
+// copied so they must stay around while the groove is in use -
+// changes to them take effect on the next step. A length of 0
+// turns the groove off. Either array can be 0.
+//
+// @access public
+// @param array of step timing offsets
+// @param array of step velocity offsets
+// @param groove length in steps, max FS_MAX_GROOVE
+// @return void
+//
+void SixteenStep::setGroove(const int8_t *timing, const int8_t *velocity, int length)
+{
+  _lock();
+  _groove_timing = timing;
+  _groove_velocity = velocity;
+  _groove_length = constrain(length, 0, FS_MAX_GROOVE);
+  _unlock();
+}
+
 // setMidiHandler
 //
 // IMPORTANT: Setting a MIDI handler is required for the sequencer
@@ -425,6 +522,8 @@ void SixteenStep::setNote(byte channel, byte pitch, byte velocity)
   int position = _quantizedPosition();
   bool added = false;
 
+  _changed();
+
   
   for(int i=0; i < _sequence_size; ++i)
   {
@@ -446,10 +545,11 @@ void SixteenStep::setNote(byte channel, byte pitch, byte velocity)
     {
 
 	
-      if(velocity > 0 && _sequence[i].velocity > 0)
-		noInterrupts(); // only write to the sequencer with interrupts disabled
+      if(velocity > 0 && _sequence[i].velocity > 0) {
+		_lock(); // only write to the sequencer with interrupts disabled
         _sequence[i] = DEFAULT_NOTE;
-		interrupts();
+		_unlock();
+      }
     }
 
 /* RH mod to see if I could get sequence shifting to work - doesn't seem to help
@@ -470,22 +570,22 @@ void SixteenStep::setNote(byte channel, byte pitch, byte velocity)
     // use a free slot
     if(_sequence[i].pitch == 0 && _sequence[i].step == 0 && _sequence[i].channel == 0 && !added)
     {
-	  noInterrupts(); // only write to the sequencer with interrupts disabled 
+	  _lock(); // only write to the sequencer with interrupts disabled 
       _sequence[i].channel = channel;
       _sequence[i].pitch = pitch;
       _sequence[i].velocity = velocity;
       _sequence[i].step = position;
       added = true;
 	  _mutenotes=true; // RH temporarily silence this note during recording 
-	  interrupts();
+	  _unlock();
 
     }
 
   }
 
-  noInterrupts(); // only write to the sequencer with interrupts disabled  
+  _lock(); // only write to the sequencer with interrupts disabled  
   _heapSort();
-  interrupts();
+  _unlock();
 }
 
 // setNote - added by RH Aug 2024
@@ -504,40 +604,285 @@ void SixteenStep::setNote( int position, byte channel, byte pitch, byte velocity
 {
 
   bool added = false;
+
+  _changed();
   
   for(int i=0; i < _sequence_size; ++i)
   {
   // overwrite note if its already there
     if( _sequence[i].step == position && _sequence[i].channel == channel && !added)
     {	
-	  noInterrupts(); // only write to the sequencer with interrupts disabled
+	  _lock(); // only write to the sequencer with interrupts disabled
       _sequence[i].channel = channel;
       _sequence[i].pitch = pitch;
       _sequence[i].velocity = velocity;
       _sequence[i].step = position;
+      _sequence[i].offset = 0;
+      _sequence[i].trig = 0;
+      _sequence[i].ratchet = 0;
+      _sequence[i].sample = 0;
       added = true;
 	  // Serial.printf(" overwriting note at index %d with position %d pitch %d\n",i,position,pitch);
-	  interrupts();
+	  _unlock();
     }
 
     // use a free slot
     if(_sequence[i].pitch == 0 && _sequence[i].step == 0 && _sequence[i].channel == 0 && !added)
     {
-	  noInterrupts(); // only write to the sequencer with interrupts disabled
+	  _lock(); // only write to the sequencer with interrupts disabled
       _sequence[i].channel = channel;
       _sequence[i].pitch = pitch;
       _sequence[i].velocity = velocity;
       _sequence[i].step = position;
+      _sequence[i].offset = 0;
+      _sequence[i].trig = 0;
+      _sequence[i].ratchet = 0;
+      _sequence[i].sample = 0;
 	  added = true;
-	  interrupts();
+	  _unlock();
 // Serial.printf("using free slot at index %d with position %d pitch %d\n",i,position,pitch);
     }
 
   }
 
-  noInterrupts(); // only write to the sequencer with interrupts disabled
+  _lock(); // only write to the sequencer with interrupts disabled
   _heapSort(); // RH probably not necessary
-  interrupts();
+  _unlock();
+}
+
+// findStep
+//
+// Works out which step and tick offset was playing ticksago ticks
+// ago, pulled towards the nearest step by strength percent.
+// Used for recording and for turning timestamped events into clips.
+// The groove is ignored - steps are taken as setTicksPerStep() long.
+// Only works when the sequencer is clocked with tick().
+//
+// @access public
+// @param ticks ago
+// @param quantize strength 0-100
+// @param returns the step
+// @param returns the tick offset in the step
+// @return false if the position is not known
+//
+bool SixteenStep::findStep(long ticksago, int strength, int *step, int *tickoffset)
+{
+  int position = _position;
+  long offset = _tick_count - ticksago;
+
+  if(_ticks_per_step <= 0 || _position < 0 || _steps <= 0)
+    return false;
+
+  strength = constrain(strength, 0, 100);
+
+  // work back from the current step to the step the note was played in
+  if(offset < 0)
+  {
+    long back = (-offset + _ticks_per_step - 1) / _ticks_per_step;
+    offset += back * _ticks_per_step;
+    position = (int)(((position - back) % _steps + _steps) % _steps);
+  }
+
+  // pull the note towards the nearest step
+  if(offset * 2 < _ticks_per_step)
+    offset = (offset * (100 - strength)) / 100;
+  else
+  {
+    offset = _ticks_per_step - ((_ticks_per_step - offset) * (100 - strength)) / 100;
+    if(offset >= _ticks_per_step)
+    {
+      offset = 0;
+      if(++position >= _steps)
+        position = 0;
+    }
+  }
+
+  *step = position;
+  *tickoffset = (int)offset;
+  return true;
+}
+
+// setTrig
+//
+// Sets the trig condition and chance of the note at position on
+// channel - make the value with FS_TRIG(). Does nothing if there
+// is no note there.
+//
+// @access public
+// @param position of note
+// @param channel
+// @param trig value
+// @return void
+//
+void SixteenStep::setTrig(int position, byte channel, byte trig)
+{
+  _changed();
+
+  for(int i=0; i < _sequence_size; ++i)
+  {
+    if(_sequence[i].step != position || _sequence[i].channel != channel || _sequence[i].pitch == 0)
+      continue;
+    _lock(); // only write to the sequencer with interrupts disabled
+    _sequence[i].trig = trig;
+    _unlock();
+    return;
+  }
+}
+
+// setRatchet
+//
+// Sets how many times the note at position on channel repeats
+// over its step and how the repeats are spaced - make the value
+// with FS_RATCHET(). Does nothing if there is no note there.
+//
+// @access public
+// @param position of note
+// @param channel
+// @param ratchet value
+// @return void
+//
+void SixteenStep::setRatchet(int position, byte channel, byte ratchet)
+{
+  _changed();
+
+  for(int i=0; i < _sequence_size; ++i)
+  {
+    if(_sequence[i].step != position || _sequence[i].channel != channel || _sequence[i].pitch == 0)
+      continue;
+    _lock(); // only write to the sequencer with interrupts disabled
+    _sequence[i].ratchet = ratchet;
+    _unlock();
+    return;
+  }
+}
+
+// setSample
+//
+// Sets the sample lock of the note at position on channel. It is
+// passed to the MIDI callback when the note plays. Does nothing if
+// there is no note there.
+//
+// @access public
+// @param position of note
+// @param channel
+// @param sample lock - 0 for none
+// @return void
+//
+void SixteenStep::setSample(int position, byte channel, byte sample)
+{
+  _changed();
+
+  for(int i=0; i < _sequence_size; ++i)
+  {
+    if(_sequence[i].step != position || _sequence[i].channel != channel || _sequence[i].pitch == 0)
+      continue;
+    _lock(); // only write to the sequencer with interrupts disabled
+    _sequence[i].sample = sample;
+    _unlock();
+    return;
+  }
+}
+
+// setFill
+//
+// Turns fill on or off for FS_TRIG_FILL and FS_TRIG_NOT_FILL notes.
+// Takes effect on the next note played.
+//
+// @access public
+// @param fill on
+// @return void
+//
+void SixteenStep::setFill(bool fill)
+{
+  _fill = fill;
+}
+
+// setSeed
+//
+// Sets the starting point of the random numbers used for trig
+// chances. The numbers restart from the seed at start() so a
+// clip plays the same variations every time it is started.
+// Give each sequencer a different seed so they vary independently.
+//
+// @access public
+// @param seed - 0 is replaced by 1
+// @return void
+//
+void SixteenStep::setSeed(unsigned long seed)
+{
+  _seed = seed ? seed : 1;
+  _random = _seed;
+}
+
+// setPlayChannel
+//
+// Only notes on this channel are played, or all of them with
+// FS_ALL_CHANNELS (the default). Notes that aren't played don't
+// use up random numbers or change the FS_TRIG_PRE state.
+//
+// @access public
+// @param channel, FS_ALL_CHANNELS or FS_NO_CHANNEL
+// @return void
+//
+void SixteenStep::setPlayChannel(int channel)
+{
+  _play_channel = channel;
+}
+
+// recordNote
+//
+// Records a note played live at its real time rather than at the
+// time it gets here. ticksago is how many ticks ago the note was
+// played including any latency compensation. The note is moved
+// towards the nearest step by strength percent - 100 snaps it to
+// the step, 0 keeps the exact timing as a tick offset. Overwrites
+// any note on the same step and channel like setNote(position,...).
+// Only works when the sequencer is clocked with tick().
+//
+// @access public
+// @param channel
+// @param pitch of note
+// @param velocity of note
+// @param ticks since the note was played
+// @param quantize strength 0-100
+// @return void
+//
+void SixteenStep::recordNote(byte channel, byte pitch, byte velocity, int ticksago, int strength)
+{
+  int position, offset;
+
+  // don't save notes if the sequencer isn't running
+  if(! _running)
+    return;
+
+  if(! findStep(ticksago, strength, &position, &offset))
+    return;
+
+  setNote(position, channel, pitch, velocity);
+
+  // setNote() clears the offset - put it back
+  for(int i=0; i < _sequence_size; ++i)
+  {
+    if(_sequence[i].step == position && _sequence[i].channel == channel && _sequence[i].pitch == pitch)
+    {
+      _lock();
+      _sequence[i].offset = offset;
+      // the note was already heard live - if it is still to come in this
+      // step or the next one don't play it again this time around
+      int next = (_position + 1) >= _steps ? 0 : _position + 1;
+      if((position == _position && offset > _tick_count) || (position == next && position != _position))
+      {
+        _skip_note = _sequence[i];
+        _skip = true;
+      }
+      // late notes for this step were looked for when it started
+      if(position == _position && offset > 0)
+        _late_notes = true;
+      _unlock();
+      break;
+    }
+  }
+
 }
 
 // removeNotes - added by RH aug 2024. 
@@ -551,12 +896,14 @@ void SixteenStep::setNote( int position, byte channel, byte pitch, byte velocity
 void SixteenStep::removeNotes(byte channel)
 {
 
+  _changed();
+
   for(int i=0; i < _sequence_size; ++i) {
     // matches the  channel
     if(_sequence[i].channel == channel) {
-	  noInterrupts(); // only write to the sequencer with interrupts disabled
+	  _lock(); // only write to the sequencer with interrupts disabled
 	  _sequence[i] = DEFAULT_NOTE;
-	  interrupts();
+	  _unlock();
 	}
   }
 }
@@ -572,19 +919,21 @@ void SixteenStep::removeNotes(byte channel)
 void SixteenStep::removeNote(int position,byte channel)
 {
 
+  _changed();
+
   for(int i=0; i < _sequence_size; ++i)
   {
   // overwrite note if its already there
     if( _sequence[i].step == position && _sequence[i].channel == channel)
     {	
-	  noInterrupts(); // only write to the sequencer with interrupts disabled
+	  _lock(); // only write to the sequencer with interrupts disabled
 	  _sequence[i] = DEFAULT_NOTE;
-	  interrupts();
+	  _unlock();
     }
   }
-  noInterrupts(); // only write to the sequencer with interrupts disabled
+  _lock(); // only write to the sequencer with interrupts disabled
   _heapSort(); // RH probably not necessary
-  interrupts();
+  _unlock();
 }
 
 
@@ -620,6 +969,263 @@ void SixteenStep::dumpNotes(void)
 		Serial.printf("dump: seq %d step %d ch x%02x pitch %d vel %d\n", i,_sequence[i].step,_sequence[i].channel, _sequence[i].pitch,_sequence[i].velocity);
 }
 
+// setClip
+//
+// Replaces all the notes on a channel with a new clip in one go.
+// setNote() rescans and re-sorts the whole note buffer for every note
+// with interrupts off, which is far too slow for regenerating a long clip.
+// Here the new note buffer is built in the spare buffer with interrupts on
+// and swapped in with a pointer exchange, so the sequencer only ever sees
+// the old clip or the new one and interrupts are off for a few cycles.
+// The clip array is indexed by step - steps with pitch 0 are empty.
+//
+// @access public
+// @param channel to replace
+// @param array of notes indexed by step
+// @param number of steps in the clip array
+// @return void
+//
+void SixteenStep::setClip(byte channel, SixteenStepNote *clip, int steps)
+{
+  _changed();
+  if(! _takeSpare(false))
+    return;
+  _buildClip(channel, clip, steps, steps);
+  _commit();
+}
+
+// queueClip
+//
+// Same as setClip() but the new clip is not swapped in until the
+// sequencer gets back to step 0, so a clip can be prepared while the
+// current one is still playing and it starts exactly on the loop point.
+// The swap is a pointer exchange so it takes the same time for any clip
+// length. Any other note write before the loop point cancels the queued
+// clip since it was built from the old notes - check clipQueued().
+// The queued clip holds one of the shared spare buffers till the loop
+// point. Fails if the other sequencers have the spares queued - try
+// again later, one comes back each time a queued clip is swapped in.
+//
+// @access public
+// @param channel to replace
+// @param array of notes indexed by step
+// @param number of steps in the clip array
+// @return true if the clip was queued
+//
+bool SixteenStep::queueClip(byte channel, SixteenStepNote *clip, int steps)
+{
+  _dequeue();
+  if(! _takeSpare(true))
+    return false;
+  _changed();
+  _buildClip(channel, clip, steps, steps);
+  _queued = true;
+  return true;
+}
+
+// canQueueClip
+//
+// Returns true if there is a spare buffer for queueClip() so
+// the sketch doesn't build a clip that can't be queued
+//
+// @access public
+// @return bool
+//
+bool SixteenStep::canQueueClip(void)
+{
+  return _queued || (_sequence_size == _spare_size && _spare_count > 1);
+}
+
+// clipQueued
+//
+// Returns true while a queued clip is waiting for the loop point
+//
+// @access public
+// @return bool
+//
+bool SixteenStep::clipQueued(void)
+{
+  return _queued;
+}
+
+// getClip
+//
+// Copies the notes on a channel into an array indexed by step in
+// one pass over the note buffer. Steps with no note are set to
+// DEFAULT_NOTE. Like getNote() only the first note on a step is kept.
+//
+// @access public
+// @param channel to copy
+// @param array to fill - must hold at least steps notes
+// @param number of steps to copy
+// @return void
+//
+void SixteenStep::getClip(byte channel, SixteenStepNote *clip, int steps)
+{
+  for(int s=0; s < steps; ++s)
+    clip[s] = DEFAULT_NOTE;
+
+  for(int i=0; i < _sequence_size; ++i)
+  {
+    if(_sequence[i].channel != channel || _sequence[i].pitch == 0 || _sequence[i].velocity == 0)
+      continue;
+    if(_sequence[i].step >= steps || clip[_sequence[i].step].pitch != 0)
+      continue;
+    clip[_sequence[i].step] = _sequence[i];
+  }
+}
+
+// pasteClip
+//
+// Same as setClip() but the clip is repeated until it fills the
+// sequencer length, so a short clip can be pasted into a longer one
+//
+// @access public
+// @param channel to replace
+// @param array of notes indexed by step
+// @param number of steps in the clip array
+// @return void
+//
+void SixteenStep::pasteClip(byte channel, SixteenStepNote *clip, int steps)
+{
+  _changed();
+  if(! _takeSpare(false))
+    return;
+  _buildClip(channel, clip, steps, _steps);
+  _commit();
+}
+
+// clearClip
+//
+// Removes all the notes on a channel in one atomic write
+//
+// @access public
+// @param channel to clear
+// @return void
+//
+void SixteenStep::clearClip(byte channel)
+{
+  _changed();
+  if(! _takeSpare(false))
+    return;
+  _buildClip(channel, 0, 0, 0);
+  _commit();
+}
+
+// rotateClip
+//
+// Moves every note on a channel by shift steps, wrapping around
+// the sequencer length. Positive values move notes later. The notes
+// are moved in one pass through the spare buffer and swapped in so
+// the sequencer never plays a half rotated clip.
+//
+// @access public
+// @param channel to rotate
+// @param number of steps to move - can be negative
+// @return void
+//
+void SixteenStep::rotateClip(byte channel, int shift)
+{
+  int n;
+
+  if(_steps <= 0)
+    return;
+  shift = ((shift % _steps) + _steps) % _steps;
+  _changed();
+  if(! _takeSpare(false))
+    return;
+  n = _keepOthers(channel);
+  for(int i=0; i < _sequence_size && n < _sequence_size; ++i)
+  {
+    if(_sequence[i].channel != channel || _sequence[i].pitch == 0)
+      continue;
+    _back[n] = _sequence[i];
+    _back[n].step = (_sequence[i].step + shift) % _steps;
+    ++n;
+  }
+  while(n < _sequence_size)
+    _back[n++] = DEFAULT_NOTE;
+  _commit();
+}
+
+// transposeClip
+//
+// Adds semitones to the pitch of every note on a channel.
+// Pitches are kept in the range 1-127 so no note is lost.
+//
+// @access public
+// @param channel to transpose
+// @param number of semitones - can be negative
+// @return void
+//
+void SixteenStep::transposeClip(byte channel, int semitones)
+{
+  int n;
+
+  _changed();
+  if(! _takeSpare(false))
+    return;
+  n = _keepOthers(channel);
+  for(int i=0; i < _sequence_size && n < _sequence_size; ++i)
+  {
+    if(_sequence[i].channel != channel || _sequence[i].pitch == 0)
+      continue;
+    _back[n] = _sequence[i];
+    _back[n].pitch = constrain(_sequence[i].pitch + semitones, 1, 127);
+    ++n;
+  }
+  while(n < _sequence_size)
+    _back[n++] = DEFAULT_NOTE;
+  _commit();
+}
+
+// getVersion
+//
+// Returns a number that changes every time the notes change.
+// Lets the sketch tell if a copy of the notes it made earlier is
+// still the same as what the sequencer is playing. Read with
+// interrupts off since the sequencer bumps it when it swaps in
+// a queued clip
+//
+// @access public
+// @return version number
+//
+unsigned long SixteenStep::getVersion(void)
+{
+  unsigned long version;
+
+  _lock();
+  version = _version;
+  _unlock();
+  return version;
+}
+
+// getMaxLockTime
+//
+// Returns the longest time in microseconds that interrupts were
+// disabled by a note write. Always 0 unless FS_MEASURE_LOCK_TIME
+// is defined in SixteenStep.h
+//
+// @access public
+// @return time in microseconds
+//
+unsigned long SixteenStep::getMaxLockTime(void)
+{
+  return _max_lock;
+}
+
+// clearMaxLockTime
+//
+// Resets the longest interrupts off time
+//
+// @access public
+// @return void
+//
+void SixteenStep::clearMaxLockTime(void)
+{
+  _max_lock = 0;
+}
+
 
 // pause
 //
@@ -647,6 +1253,14 @@ void SixteenStep::start()
 //  _position = 0;
 	_position = -1; // RH fix for first step not playing when start() is called
   _running = true;
+  _tick_count = 0; // step on the next tick() when externally clocked
+  _tick_length = 1 + max(0, _grooveOffset(0)); // unless the groove makes the first step late
+  _stepcount = 0;
+  _skip = false;
+  _loops = 0;
+  _pre = false;
+  _random = _seed;
+  _active_ratchets = 0;
   
   // RH added update clock stuff from run()
   // otherwise sequencers immediately advance 
@@ -692,10 +1306,11 @@ void SixteenStep::panic()
   {
     // send all notes off for each channel if callback is set
     if(_midi_cb)
-      _midi_cb(i, 0x7B, 0x0, 0x0);
+      _midi_cb(i, 0x7B, 0x0, 0x0, 0x0);
   }
 
   // clear notes
+  _changed();
   _resetSequence();
 
 }
@@ -712,7 +1327,9 @@ void SixteenStep::panic()
 // use when the class is initialized. Lowering the
 // amount of memory the sequencer uses will effect the
 // amount of polyphony the sequencer will support. By
-// default the sequencer allocates 1k of sram.
+// default the sequencer allocates 1k of sram. The first
+// sequencer also allocates FS_SPARE_BUFFERS spare buffers the
+// same size, shared by all the sequencers for bulk clip writes.
 //
 // @access private
 // @param the amount of sram to use in bytes
@@ -727,8 +1344,38 @@ void SixteenStep::_init(int memory)
   _position = 0;
   _shuffle = 0;
   _mutenotes =0; // RH added to silence the current note during recording
+  _max_lock = 0;
+  _queued = false;
+  _version = 0;
+  _ticks_per_step = 0;
+  _tick_count = 0;
+  _tick_length = 1;
+  _stepcount = 0;
+  _groove_timing = 0;
+  _groove_velocity = 0;
+  _groove_length = 0;
+  _groove_step = 0;
+  _late_notes = false;
+  _skip = false;
+  _play_channel = FS_ALL_CHANNELS;
+  _loops = 0;
+  _fill = false;
+  _pre = false;
+  _seed = 1;
+  _random = 1;
+  _active_ratchets = 0;
   _sequence_size = memory / sizeof(SixteenStepNote);
   _sequence = new SixteenStepNote[_sequence_size];
+  _back = 0;
+
+  // the spares are swapped with the sequencers' own buffers so they are all the same size
+  if(_spare_size == 0)
+  {
+    _spare_size = _sequence_size;
+    for(int i=0; i < FS_SPARE_BUFFERS; ++i)
+      _spares[i] = new SixteenStepNote[_spare_size];
+    _spare_count = FS_SPARE_BUFFERS;
+  }
 
   // set up default notes
   _resetSequence();
@@ -764,6 +1411,193 @@ void SixteenStep::_resetSequence()
     _sequence[i] = DEFAULT_NOTE;
 }
 
+// _lock
+//
+// Disables interrupts so the sequencer doesn't run while
+// the note buffer is being changed
+//
+// @access private
+// @return void
+void SixteenStep::_lock()
+{
+  noInterrupts();
+#ifdef FS_MEASURE_LOCK_TIME
+  _lock_start = micros();
+#endif
+}
+
+// _unlock
+//
+// Enables interrupts again and keeps track of the longest
+// time they were off if FS_MEASURE_LOCK_TIME is defined
+//
+// @access private
+// @return void
+void SixteenStep::_unlock()
+{
+#ifdef FS_MEASURE_LOCK_TIME
+  unsigned long locked = micros() - _lock_start;
+  if(locked > _max_lock)
+    _max_lock = locked;
+#endif
+  interrupts();
+}
+
+// _keepOthers
+//
+// Copies the notes on every other channel to the start of
+// the spare buffer. Runs with interrupts on - the sequencer
+// never reads the spare buffer
+//
+// @access private
+// @param channel that is about to be replaced
+// @return number of notes copied
+int SixteenStep::_keepOthers(byte channel)
+{
+  int n = 0;
+
+  for(int i=0; i < _sequence_size; ++i)
+  {
+    if(_sequence[i].pitch == 0 || _sequence[i].channel == channel)
+      continue;
+    _back[n++] = _sequence[i];
+  }
+  return n;
+}
+
+// _buildClip
+//
+// Fills the spare buffer with the current notes on every other
+// channel plus the new clip. The clip is repeated until length
+// steps are filled
+//
+// @access private
+// @param channel to replace
+// @param array of notes indexed by step
+// @param number of steps in the clip array
+// @param number of steps to fill
+// @return void
+void SixteenStep::_buildClip(byte channel, SixteenStepNote *clip, int steps, int length)
+{
+  int n = _keepOthers(channel);
+
+  // nothing to repeat
+  if(steps <= 0)
+    length = 0;
+
+  // add the new clip
+  for(int s=0, c=0; s < length && n < _sequence_size; ++s)
+  {
+    if(clip[c].pitch != 0)
+    {
+      _back[n] = clip[c];
+      _back[n].channel = channel;
+      _back[n].step = s;
+      ++n;
+    }
+    if(++c >= steps)
+      c = 0;
+  }
+
+  // the rest are free slots
+  while(n < _sequence_size)
+    _back[n++] = DEFAULT_NOTE;
+}
+
+// _changed
+//
+// Called at the start of every write to the note buffer.
+// Bumps the version number so the sketch can tell the notes
+// changed and cancels any queued clip. The bump is done with
+// interrupts off - the sequencer bumps it too when it swaps in
+// a queued clip and an increment it interrupted would be lost
+//
+// @access private
+// @return void
+void SixteenStep::_changed()
+{
+  _lock();
+  ++_version;
+  _unlock();
+  _dequeue();
+}
+
+// _dequeue
+//
+// Cancels a queued clip so the spare buffer can be reused.
+// Done with interrupts off so the sequencer can't swap it
+// in while we are taking it back. _queued is checked again
+// with interrupts off since the sequencer may have swapped it in
+// after the first check - the spare is back in the pool then
+//
+// @access private
+// @return void
+void SixteenStep::_dequeue()
+{
+  if(! _queued)
+    return;
+  _lock();
+  if(_queued && _back != 0)
+    _spares[_spare_count++] = _back;
+  _queued = false;
+  _back = 0;
+  _unlock();
+}
+
+// _takeSpare
+//
+// Takes a spare buffer from the shared pool to build a bulk
+// write in. A queued clip can't take the last one, so setClip()
+// and the other writes that swap in straight away always get one.
+// A sequencer with a different buffer size than the first one
+// can't use the spares so its bulk writes do nothing
+//
+// @access private
+// @param true if the spare will hold a queued clip
+// @return true if _back now has a spare
+bool SixteenStep::_takeSpare(bool queue)
+{
+  bool ok;
+
+  if(_sequence_size != _spare_size)
+    return false;
+  _lock();
+  ok = _spare_count > (queue ? 1 : 0);
+  if(ok)
+    _back = _spares[--_spare_count];
+  _unlock();
+  return ok;
+}
+
+// _swapSpare
+//
+// Makes the spare buffer the active note buffer and gives the
+// old one back to the pool. Only pointers change so this takes
+// the same time no matter how many notes changed. Must be
+// called with interrupts off
+//
+// @access private
+// @return void
+void SixteenStep::_swapSpare()
+{
+  _spares[_spare_count++] = _sequence;
+  _sequence = _back;
+  _back = 0;
+}
+
+// _commit
+//
+// Swaps the spare buffer in as the active note buffer
+//
+// @access private
+// @return void
+void SixteenStep::_commit()
+{
+  _lock();
+  _swapSpare();
+  _unlock();
+}
+
 // _quantizedPosition
 //
 // Returns the closest 16th note to the
@@ -777,6 +1611,16 @@ int SixteenStep::_quantizedPosition()
 {
   unsigned long now;
   
+  // externally clocked - go to the next step if we are past the middle of this one
+  if(_ticks_per_step > 0)
+  {
+    if((_tick_count * 2) < _tick_length)
+      return _position;
+    if((_position + 1) >= _steps)
+      return 0;
+    return _position + 1;
+  }
+
   if(_shuffle > 0)
     return _position;
 
@@ -826,6 +1670,17 @@ void SixteenStep::_step()
   if(_position >= _steps)
     _position = 0;
 
+  // count the loops for A:B trigs
+  if(_position == 0 && last >= 0)
+    ++_loops;
+
+  // swap in a queued clip right on the loop point
+  if(_position == 0 && _queued) {
+    _swapSpare();
+    _queued = false;
+    ++_version;
+  }
+
 
   // tell the callback where we are
   // if it has been set by the sketch
@@ -853,7 +1708,7 @@ void SixteenStep::_tick()
     return;
 
   // tick
-  _midi_cb(0x0, 0xF8, 0x0, 0x0);
+  _midi_cb(0x0, 0xF8, 0x0, 0x0, 0x0);
 
 }
 
@@ -873,7 +1728,7 @@ void SixteenStep::_loopPosition()
     return;
 
   // send position
-  _midi_cb(0x0, 0xF2, 0x0, _position);
+  _midi_cb(0x0, 0xF2, 0x0, _position, 0x0);
 
 }
 
@@ -997,6 +1852,8 @@ void SixteenStep::_triggerNotes()
 	return;
   }
 
+  _late_notes = false;
+
   // loop through the sequence again and trigger note ons at the current position
   for(int i=0; i < _sequence_size; ++i)
   {
@@ -1009,14 +1866,273 @@ void SixteenStep::_triggerNotes()
     if(_sequence[i].pitch == 0 && _sequence[i].velocity == 0 && _sequence[i].step == 0)
       continue;
 
+    // notes with an offset are played later by tick()
+    if(_sequence[i].offset > 0 && _ticks_per_step > 0)
+    {
+      _late_notes = true;
+      continue;
+    }
+
+    // already played live while recording
+    if(_skipNote(i))
+      continue;
+
+    if(! _playNote(i))
+      continue;
+
     // send note on values to callback
     _midi_cb(
       _sequence[i].channel,
       _sequence[i].velocity > 0 ? 0x9 : 0x8,
       _sequence[i].pitch,
-      _sequence[i].velocity
+      _grooveVelocity(_sequence[i].velocity),
+      _sequence[i].sample
     );
 
+    if(_sequence[i].ratchet != 0)
+      _startRatchet(i);
+
   }
 
 }
+
+// _triggerLateNotes
+//
+// Calls the user defined MIDI callback with the notes in the
+// current step that are offset to the current tick. Notes with
+// offsets past the end of a shortened (shuffled) step are played
+// on its last tick.
+//
+// @access private
+// @return void
+//
+void SixteenStep::_triggerLateNotes()
+{
+
+  // bail if the midi callback isn't set
+  if(! _midi_cb)
+    return;
+
+  bool last = (_tick_count + 1) >= _tick_length;
+
+  for(int i=0; i < _sequence_size; ++i)
+  {
+
+    if(_sequence[i].step != _position || _sequence[i].pitch == 0)
+      continue;
+
+    if(_sequence[i].offset != _tick_count && !(last && _sequence[i].offset > _tick_count))
+      continue;
+
+    if(_skipNote(i))
+      continue;
+
+    if(! _playNote(i))
+      continue;
+
+    _midi_cb(
+      _sequence[i].channel,
+      _sequence[i].velocity > 0 ? 0x9 : 0x8,
+      _sequence[i].pitch,
+      _grooveVelocity(_sequence[i].velocity),
+      _sequence[i].sample
+    );
+
+    if(_sequence[i].ratchet != 0)
+      _startRatchet(i);
+
+  }
+
+}
+
+// _skipNote
+//
+// Returns true once if note i is the note that was just recorded,
+// so a note played live isn't played again right away
+//
+// @access private
+// @param index of note
+// @return bool
+//
+bool SixteenStep::_skipNote(int i)
+{
+  if(! _skip)
+    return false;
+  if(_sequence[i].channel != _skip_note.channel || _sequence[i].pitch != _skip_note.pitch || _sequence[i].step != _skip_note.step)
+    return false;
+  _skip = false;
+  return true;
+}
+
+// _playNote
+//
+// Decides if note i plays this time around from its channel and
+// trig. The chance uses a xorshift random number so it costs a few
+// cycles per note in the interrupt and nothing has to be regenerated
+// to get a different variation on every loop.
+//
+// @access private
+// @param index of note
+// @return bool
+//
+bool SixteenStep::_playNote(int i)
+{
+  static const byte a[] = {1, 2, 1, 2, 3, 1, 2, 3, 4};
+  static const byte b[] = {2, 2, 3, 3, 3, 4, 4, 4, 4};
+  byte trig = _sequence[i].trig;
+  byte condition = FS_TRIG_CONDITION(trig);
+  bool play;
+
+  if(_play_channel != FS_ALL_CHANNELS && _sequence[i].channel != _play_channel)
+    return false;
+
+  if(trig == 0)
+    return true;
+
+  switch(condition)
+  {
+    case FS_TRIG_ALWAYS:
+      play = true;
+      break;
+    case FS_TRIG_FILL:
+      play = _fill;
+      break;
+    case FS_TRIG_NOT_FILL:
+      play = ! _fill;
+      break;
+    case FS_TRIG_PRE:
+      play = _pre;
+      break;
+    case FS_TRIG_NOT_PRE:
+      play = ! _pre;
+      break;
+    case FS_TRIG_FIRST:
+      play = _loops == 0;
+      break;
+    case FS_TRIG_NOT_FIRST:
+      play = _loops != 0;
+      break;
+    default:  // A:B
+      play = (_loops % b[condition - FS_TRIG_1_2]) == (unsigned long)(a[condition - FS_TRIG_1_2] - 1);
+      break;
+  }
+
+  if(play && FS_TRIG_SKIP(trig) != 0)
+  {
+    _random ^= _random << 13;  // xorshift32
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    play = (_random >> 28) >= FS_TRIG_SKIP(trig);
+  }
+
+  // PRE and NOT PRE follow the last note that had a condition or a chance
+  if(condition != FS_TRIG_PRE && condition != FS_TRIG_NOT_PRE)
+    _pre = play;
+
+  return play;
+}
+
+// _startRatchet
+//
+// Starts repeating note i, which has just played its first hit.
+// Only works when clocked with tick(). If all the ratchet slots
+// are busy the note just plays once.
+//
+// @access private
+// @param index of note
+// @return void
+//
+void SixteenStep::_startRatchet(int i)
+{
+  if(_ticks_per_step <= 0 || _active_ratchets >= FS_MAX_RATCHETS)
+    return;
+
+  SixteenStepRatchet *r = &_ratchets[_active_ratchets++];
+  r->channel = _sequence[i].channel;
+  r->pitch = _sequence[i].pitch;
+  r->velocity = _grooveVelocity(_sequence[i].velocity);
+  r->ratchet = _sequence[i].ratchet;
+  r->sample = _sequence[i].sample;
+  r->hit = 1;
+  r->ticks = 0;
+}
+
+// _runRatchets
+//
+// Plays any ratchet repeats that are due on this tick. The repeats
+// are spread over one step from the first hit. Repeat k of n is at
+// k/n of the step when evenly spaced, and at 1-(1-k/n)^2 or (k/n)^2
+// of the step for the faster and slower curves. Repeats that land on
+// the same tick are played on the following ticks.
+//
+// @access private
+// @return void
+//
+void SixteenStep::_runRatchets()
+{
+  for(int j=0; j < _active_ratchets; )
+  {
+    SixteenStepRatchet *r = &_ratchets[j];
+    long n = FS_RATCHET_COUNT(r->ratchet);
+    long k = r->hit;
+    long due;
+
+    switch(FS_RATCHET_CURVE(r->ratchet))
+    {
+      case FS_RATCHET_FASTER:
+        due = (_ticks_per_step * k * (2 * n - k)) / (n * n);
+        break;
+      case FS_RATCHET_SLOWER:
+        due = (_ticks_per_step * k * k) / (n * n);
+        break;
+      default:
+        due = (_ticks_per_step * k) / n;
+        break;
+    }
+
+    if(++r->ticks >= due)
+    {
+      if(_midi_cb)
+        _midi_cb(r->channel, r->velocity > 0 ? 0x9 : 0x8, r->pitch, r->velocity, r->sample);
+
+      // finished - move the last one into this slot
+      if(++r->hit >= n)
+      {
+        _ratchets[j] = _ratchets[--_active_ratchets];
+        continue;
+      }
+    }
+    ++j;
+  }
+}
+
+// _grooveOffset
+//
+// Returns how many ticks the groove moves a step
+//
+// @access private
+// @param steps since start()
+// @return ticks - negative is early
+//
+int SixteenStep::_grooveOffset(unsigned long stepcount)
+{
+  if(_groove_length <= 0 || ! _groove_timing)
+    return 0;
+  return (_groove_timing[stepcount % _groove_length] * _ticks_per_step) / FS_GROOVE_RESOLUTION;
+}
+
+// _grooveVelocity
+//
+// Adds the groove velocity of the current step to a note velocity.
+// Notes stay in the range 1-127 so the groove never turns one off.
+//
+// @access private
+// @param note velocity
+// @return velocity to play
+//
+byte SixteenStep::_grooveVelocity(byte velocity)
+{
+  if(velocity == 0 || _groove_length <= 0 || ! _groove_velocity)
+    return velocity;
+  return constrain(velocity + _groove_velocity[_groove_step % _groove_length], 1, 127);
+}
@@ -22,6 +22,41 @@
 #define FS_MAX_TEMPO 250
 #define FS_MAX_STEPS 128 // step is 8 bits so max 255
 //#define FS_MAX_STEPS 16
+#define FS_SPARE_BUFFERS 4 // spare note buffers shared by all the sequencers for bulk clip writes - one is kept for setClip() etc, the rest can hold queued clips
+//#define FS_MEASURE_LOCK_TIME // uncomment to record the longest time interrupts are disabled by note writes
+#define FS_ALL_CHANNELS -1 // setPlayChannel() value that plays every channel
+#define FS_NO_CHANNEL 0x100 // setPlayChannel() value that plays nothing
+
+// trig conditions - low 4 bits of SixteenStepNote.trig
+// A:B plays on loop A of every B loops counted from start()
+#define FS_TRIG_ALWAYS 0
+#define FS_TRIG_FILL 1      // only while fill is on
+#define FS_TRIG_NOT_FILL 2  // only while fill is off
+#define FS_TRIG_PRE 3       // only if the last conditional note on this sequencer played
+#define FS_TRIG_NOT_PRE 4   // only if it didn't
+#define FS_TRIG_FIRST 5     // first loop only
+#define FS_TRIG_NOT_FIRST 6 // every loop but the first
+#define FS_TRIG_1_2 7       // 1:2 2:2 1:3 2:3 3:3 1:4 2:4 3:4 4:4 follow in order
+#define FS_TRIG_4_4 15
+
+// high 4 bits of SixteenStepNote.trig are the chance of skipping the note in 16ths - 0 always plays
+#define FS_TRIG(condition, skip) ((byte)(((skip) << 4) | (condition)))
+#define FS_TRIG_CONDITION(trig) ((trig) & 0x0f)
+#define FS_TRIG_SKIP(trig) ((trig) >> 4)
+
+// ratchets - a note can be repeated 2-8 times over one step
+// low 3 bits of SixteenStepNote.ratchet are the count-1, the next 2 bits how the repeats are spaced
+#define FS_RATCHET_EVEN 0    // evenly spaced
+#define FS_RATCHET_FASTER 1  // repeats get closer together
+#define FS_RATCHET_SLOWER 2  // repeats get further apart
+#define FS_RATCHET(count, curve) ((byte)((((count) - 1) & 7) | ((curve) << 3)))
+#define FS_RATCHET_COUNT(ratchet) (((ratchet) & 7) + 1)
+#define FS_RATCHET_CURVE(ratchet) (((ratchet) >> 3) & 3)
+#define FS_MAX_RATCHETS 4 // ratchets that can be playing at once on one sequencer
+
+// groove timing offsets are in 24ths of a step so a groove sounds the same at any setTicksPerStep()
+#define FS_GROOVE_RESOLUTION 24
+#define FS_MAX_GROOVE 32 // longest groove in steps
 
 // MIDIcallback
 //
@@ -34,13 +69,14 @@
 // command: note on or off (0x9 or 0x8)
 // arg1: pitch value
 // arg1: velocity value
+// sample: sample lock of the note - 0 if it doesn't have one
 //
 // It's possible that there will be other types of MIDI messages sent
 // to this callback in the future, so please check the command sent if
 // you are doing something other than passing on the MIDI messages to
 // a MIDI library.
 //
-typedef void (*MIDIcallback) (byte channel, byte command, byte arg1, byte arg2);
+typedef void (*MIDIcallback) (byte channel, byte command, byte arg1, byte arg2, byte sample);
 
 // StepCallback
 //
@@ -64,17 +100,43 @@ typedef uint32_t (*Timecallback) (void);
 //
 // This defines the note type that is used when storing sequence note
 // values. The notes will be set to DEFAULT_NOTE until they are modified
-// by the user.
+// by the user. offset delays the note by that many ticks after the
+// start of its step when the sequencer is clocked with tick().
+// trig holds a condition and a chance that decide if the note plays
+// each time around - see FS_TRIG(). 0 always plays.
+// ratchet repeats the note over the step - see FS_RATCHET(). 0 plays once.
+// sample is passed to the MIDI callback so a note can pick what it
+// plays - the sequencer doesn't use it. 0 for none.
 typedef struct
 {
   byte channel;
   byte pitch;
   byte velocity;
   byte step;
+  byte offset;
+  byte trig;
+  byte ratchet;
+  byte sample;
 } SixteenStepNote;
 
 // default values for sequence array members
-const SixteenStepNote DEFAULT_NOTE = {0x0, 0x0, 0x0, 0x0};
+const SixteenStepNote DEFAULT_NOTE = {0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0};
+
+// SixteenStepRatchet
+//
+// A ratchet that is playing. The repeats are worked out from the
+// note as they come due so there is one of these per playing
+// ratchet rather than a note for every repeat.
+typedef struct
+{
+  byte channel;
+  byte pitch;
+  byte velocity;
+  byte ratchet;
+  byte sample;
+  byte hit;  // repeats played so far including the first
+  int ticks;  // ticks since the first hit
+} SixteenStepRatchet;
 
 class SixteenStep
 {
@@ -87,6 +149,8 @@ class SixteenStep
     void  begin(int tempo, int steps, int polyphony);
     void  run();
 	void  step();
+	void  tick();
+	void  setTicksPerStep(int ticks);
     void  pause();
     void  start();
     void  stop();
@@ -98,22 +162,49 @@ class SixteenStep
     void  increaseShuffle();
     void  decreaseShuffle();
 	void  setShuffle(int divisions);
+	void  setGroove(const int8_t *timing, const int8_t *velocity, int length);
     void  setMidiHandler(MIDIcallback cb);
     void  setStepHandler(StepCallback cb);
 	void  setTimeHandler(Timecallback cb);
     void  setNote(byte channel, byte pitch, byte velocity);
 	void  setNote( int position, byte channel, byte pitch, byte velocity);
+	void  recordNote(byte channel, byte pitch, byte velocity, int ticksago, int strength);
+	bool  findStep(long ticksago, int strength, int *step, int *tickoffset);
+	void  setTrig(int position, byte channel, byte trig);
+	void  setRatchet(int position, byte channel, byte ratchet);
+	void  setSample(int position, byte channel, byte sample);
+	void  setFill(bool fill);
+	void  setSeed(unsigned long seed);
+	void  setPlayChannel(int channel);
 	void  removeNotes(byte channel);
 	void  removeNote(int position,byte channel);
 	void  dumpNotes(void);
+	void  setClip(byte channel, SixteenStepNote *clip, int steps);
+	bool  queueClip(byte channel, SixteenStepNote *clip, int steps);
+	bool  canQueueClip(void);
+	bool  clipQueued(void);
+	void  getClip(byte channel, SixteenStepNote *clip, int steps);
+	void  pasteClip(byte channel, SixteenStepNote *clip, int steps);
+	void  clearClip(byte channel);
+	void  rotateClip(byte channel, int shift);
+	void  transposeClip(byte channel, int semitones);
+	unsigned long getVersion(void);
+	unsigned long getMaxLockTime(void);
+	void  clearMaxLockTime(void);
 	SixteenStepNote* getNote(int position, byte channel);
   private:
     MIDIcallback      _midi_cb;
     StepCallback      _step_cb;
 	Timecallback      _time_cb;
     SixteenStepNote*  _sequence;
+    SixteenStepNote*  _back;  // spare buffer taken from _spares - bulk writes are built here then swapped in. 0 when not in use
+    static SixteenStepNote* _spares[FS_SPARE_BUFFERS];  // free spare buffers
+    static volatile int _spare_count;
+    static int        _spare_size;  // notes in each spare - the size of the first sequencer's buffer
     bool              _running;
 	bool			  _mutenotes;
+    volatile bool     _queued;  // spare buffer holds a clip waiting for the loop point
+    volatile unsigned long _version;  // bumped on every change to the notes
     int               _sequence_size;
     int               _tempo;
     int              _steps;
@@ -123,6 +214,27 @@ class SixteenStep
     unsigned long     _shuffle;
     unsigned long     _next_beat;
     unsigned long     _next_clock;
+    int               _ticks_per_step;  // 0 when clocked by millis() in run()
+    volatile int      _tick_count;  // ticks since the last step
+    int               _tick_length;  // ticks in the current step
+    unsigned long     _stepcount;  // steps since start() - used for the groove
+    const int8_t*     _groove_timing;  // groove step offsets in 24ths of a step
+    const int8_t*     _groove_velocity;  // groove velocity offsets
+    int               _groove_length;  // 0 = no groove
+    int               _groove_step;  // groove step of the current step
+    bool              _late_notes;  // notes with an offset in the current step
+    bool              _skip;  // skip _skip_note the next time it plays
+    SixteenStepNote   _skip_note;  // note that was just recorded and already played live
+    int               _play_channel;  // only notes on this channel are played
+    unsigned long     _loops;  // times around the clip since start() - for A:B trigs
+    bool              _fill;  // fill is on
+    bool              _pre;  // last conditional note played
+    uint32_t          _seed;  // random number state is reset to this at start()
+    uint32_t          _random;
+    SixteenStepRatchet _ratchets[FS_MAX_RATCHETS];
+    int               _active_ratchets;
+    unsigned long     _lock_start;
+    unsigned long     _max_lock;
     unsigned long     _shuffleDivision();
     int               _quantizedPosition();
     int               _greater(int first, int second);
@@ -130,10 +242,26 @@ class SixteenStep
     void              _heapSort();
     void              _siftDown(int root, int bottom);
     void              _resetSequence();
+    void              _lock();
+    void              _unlock();
+    bool              _takeSpare(bool queue);
+    void              _swapSpare();
+    void              _commit();
+    void              _changed();
+    void              _dequeue();
+    int               _keepOthers(byte channel);
+    void              _buildClip(byte channel, SixteenStepNote *clip, int steps, int length);
     void              _loopPosition();
     void              _tick();
     void              _step();
     void              _triggerNotes();
+    void              _triggerLateNotes();
+    bool              _skipNote(int i);
+    bool              _playNote(int i);
+    int               _grooveOffset(unsigned long stepcount);
+    byte              _grooveVelocity(byte velocity);
+    void              _startRatchet(int i);
+    void              _runRatchets();
 };
 
 #endif
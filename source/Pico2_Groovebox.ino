@@ -64,6 +64,7 @@
 #include "drumpatterns.h"
 
 #define DEBUG // to get serial debug info
+//#define MEASURE_RECORD_TIME // print the time from the pad scan to the recorded note - prints on every recorded note so not part of DEBUG
 
 #ifndef _BV
 #define _BV(bit) (1 << (bit)) 
@@ -142,11 +143,10 @@ Adafruit_ST7735 display = Adafruit_ST7735(TFT_CS, TFT_RS, TFT_RESET);
 #define NSCENES  16 // works best with the keypad
 #define NUM_VOICES NTRACKS
 #define MAX_STEPS FS_MAX_STEPS // max number of notes per sequencer
-#define SEQUENCER_MEMORY 2048  // memory per sequencer (bytes)
+#define SEQUENCER_MEMORY (512*sizeof(SixteenStepNote))  // memory per sequencer (bytes) - 512 notes
 //#define SEQUENCER_MEMORY sizeof(SixteenStepNote)*MAX_STEPS // FifteenStep can record polyphonic but not using that 
 #define STEPS_PER_BAR 16
 #define TEMPO    120 // default tempo
-#define CLIPS_COMPLETE ((1<<NSCENES)-1) // bitmap of clips that are on last step
 
 // Keeps track of the last pins touched
 // so we know when buttons are released
@@ -242,19 +242,20 @@ uint8_t padmap[NPADS] = {0,4,8,16, 12,1,5,9 ,17,13,2,6, 10,18,14,3, 7,11,19,15,
 
 // globals
 int16_t bpm = TEMPO;
-int16_t shuffle[NTRACKS]={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,}; // swing/shuffle amount for each track 0-15
+int16_t groove[NTRACKS]={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,}; // groove template for each track - 0 is off
+int16_t getgroove=0; // menu control - turn to Get to make the user groove from the current clip
+int16_t division[NTRACKS]={3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,}; // step length of each track - index into divisionticks[], 3 = 1/16
 int16_t pattern[NTRACKS]={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,}; // pattern from drumpatterns.h
 int16_t patshift[NTRACKS]={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,}; // pattern shift
 int16_t patpitch[NTRACKS]={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,}; // pattern note offsets
 int16_t patvelocity[NTRACKS]={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,}; // pattern velocity offsets
+int16_t patfill[NTRACKS]={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,}; // euclidean fill triggers added to pattern
+int16_t patmode[NTRACKS]={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,}; // pattern written to clip or generated as it plays
+enum patmodes{PATMODE_CLIP,PATMODE_GEN};
 int16_t tracklevel[NTRACKS] = {500,500,500,500,500,500,500,500,500,500,500,500,500,500,500,500}; // track volume 
 int16_t trackpan[NTRACKS] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,};  // track pan
 uint32_t seqmillis; // millis() time to pass to sequencers
 
-int8_t pitchoffsets[NTRACKS][MAX_STEPS]; // random values for pitch pattern
-
-int8_t velocityoffsets[NTRACKS][MAX_STEPS]; // random values for velocity offset
-
 // sequencer modes
 bool record_mode = false;
 bool play_mode = true;
@@ -262,26 +263,26 @@ bool song_mode = false;
 bool edit_mode=false;
 bool Copybutton, Pastebutton; // button down flags
 bool shiftkey; // shift key state
-uint16_t clip_complete,clipflags; // bitmap of sequencers that have just completed last step
+uint16_t queuedclips; // bitmap of tracks with a randomized clip queued for the next loop
+int16_t nextrandomtrack=0; // track that gets the next spare sequencer buffer for a queued clip
 //int16_t steps[NTRACKS] = { 16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16}; // steps for each track
 int16_t steps[NTRACKS] = { 16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16}; // steps for each track
 int16_t scenecount[NSCENES] = {1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};  // how many times to repeat scene in song mode - values changed in song menu
+int16_t scenebars[NSCENES] = {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1};  // length of each scene in bars in song mode
 int16_t rerandomize[NTRACKS] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};  // when true re-randomize notes and velocities at end of scene
 uint8_t track=0;  // current track in UI
 int16_t scene=0; // the current scene 
-int16_t scenecounter=0; // counts down scene repeats 
 
 int16_t sequencer=0; // the sequencer currently running
 int16_t current_step=0;
 int16_t last_step=0; // so we can tell when the sequencer advanced
 int16_t last_scene=0; // so we can tell when the song scene sequencer advanced
-int16_t stepsperbar=STEPS_PER_BAR; // used by the UI to show bar:step
+int16_t stepsperbar=STEPS_PER_BAR; // 16th notes per bar - set from the time signature
+int16_t timesig=0; // time signature - index into timesigbeats[] and timesigunit[], 0 = 4/4
 int16_t current_scale=1; // musical scale in use
 int16_t master_volume = 64;
-int16_t shift=0; // shift flag used by menu system 0= shift back, 1 = shift right
-int16_t clipbuffercnt =0; // current size of clip buffer (in notes)
-SixteenStepNote clipbuffer[MAX_STEPS]; // buffer used for clip copy/paste
-SixteenStepNote scenebuffer[NTRACKS][MAX_STEPS]; // buffer used for scene copy/paste
+int16_t shift=0; // clip shift used by menu system -1 = shift back, 1 = shift forward
+SixteenStepNote patternbuffer[MAX_STEPS]; // pattern generator builds clips here before they are written to the sequencer
 
 // sequencer per track allows tracks to have different lengths and it allows clearing each track individually
 // more overhead but its a lot more flexible
@@ -369,6 +370,13 @@ MIDI_CREATE_CUSTOM_INSTANCE(HardwareSerial, MIDISerial, MIDI, SerialMIDISettings
 // I'm using the same structure for psram samples loaded from SD as the original code with flash based samples
 // there are some unused elements in this structure which were used by older code but I'm leaving them here for now
 // perhaps a bit convoluted but this way the code doesn't change significantly and in future both flash and SD could be used for sample storage
+// sample[] is a pool shared by the tracks - voice[].sample picks the one a track plays
+// a file loaded on several tracks is only stored once and is freed when the last track using it loads something else
+// the lock slots hold more samples from a kit that notes can be locked to so one track can play a whole kit
+#define LOCK_SLOTS 240             // a note's sample lock is the slot number 1-LOCK_SLOTS, 0 plays the track's sample
+#define NUM_SAMPLES (2*(NUM_VOICES+LOCK_SLOTS)) // a sample for every track and slot plus room for a kit to load while the old ones play
+#define MAX_SLICES 16              // most slices a track can play - one per numbered key
+
 struct sample_t {
   int16_t * samplearray; // pointer to sample array
   uint32_t samplesize; // size of the sample array
@@ -376,17 +384,31 @@ struct sample_t {
   uint8_t MIDINOTE;  // MIDI note on that plays this sample - NOT USED
   uint8_t play_volume; // play volume 0-127 - NOT USED
   char sname[25];        // sample name
-} sample[NUM_VOICES];
-
-#define NUM_SAMPLES (sizeof(sample)/sizeof(sample_t)) // for PSRAM this will always be the same as NUM_VOICES
+  int16_t refs;          // tracks and lock slots using this sample - free when 0, SAMPLE_RETIRING while core1 lets go of it
+  uint32_t srcsize;      // size and FAT modify date/time of the file it was loaded from
+  uint16_t srcdate;
+  uint16_t srctime;
+  uint32_t pathhash;     // hash of the file's path
+  uint32_t *slice;       // start of each slice found at load time - a table from the pool in loader.h, 0 if none
+  uint8_t slicecount;    // slices found - 0 or 1 and slice mode uses equal slices
+  bool sliced;           // the slices found at load time were kept - not for samples only loaded for lock slots
+} sample[NUM_SAMPLES];
+
+int16_t locksample[LOCK_SLOTS]; // sample[] in each lock slot - -1 if empty
 
 // initialize samples 
+// each track starts with its own empty sample so it has somewhere to show its name
 void init_samples(void) {
-  for (int i=0; i< NUM_VOICES; ++i) {
+  for (int i=0; i< NUM_SAMPLES; ++i) {
     sample[i].samplearray=0; // start with a null pointer
     sample[i].samplesize=0;
+    sample[i].slice=0;
+    sample[i].slicecount=0;
+    sample[i].sliced=false;
+    sample[i].refs=(i < NUM_VOICES) ? 1 : 0;
     strcpy(sample[i].sname,"Click to load from SD");  // no sample loaded
   }
+  for (int i=0; i< LOCK_SLOTS; ++i) locksample[i]=-1;
 }
 
 // voice structure holds info for the sample in use on each track
@@ -396,6 +418,7 @@ void init_samples(void) {
 // note that there is some other stuff in the sample structures included above. Its used by other sketches but not using it here
 struct voice_t {
   int16_t sample;   // index of sample in use - note menusystem requires signed ints
+  int16_t playsample; // sample the playing note uses - the track's sample or the note's sample lock. only changed by core1
   int16_t levelL;   // 0-128 - ideally this should be pan control vs L-R levels
   int16_t levelR;     // 0-128
   uint32_t sampleindex; // 20:12 fixed point index into the sample array
@@ -404,13 +427,18 @@ struct voice_t {
   int16_t tune;  // fine tuning of sample pitch  
   uint8_t note; // current MIDI note 
   uint8_t velocity; // midi velocity
+  uint8_t lock; // sample lock of the current note - 0 for none
   int16_t slices; // number of slices
+  uint16_t startdelay; // samples to wait before starting the note
 } voice[NUM_VOICES]; 
 
+uint16_t delayedvoices=0; // voices waiting for their start delay - only used by core1
+
 // initialize voices 
 void init_voices(void) {
   for (int i=0; i< NUM_VOICES; ++i) { 
-    voice[i].sample=i*(NUM_SAMPLES/NUM_VOICES); // init to use samples spread out over the collection - less knob turning
+    voice[i].sample=voice[i].playsample=i; // the track's own empty sample
+    voice[i].lock=0;
 
     voice[i].levelR=(map(tracklevel[i],0,1000,0,128)*map(trackpan[i],-1000,1000,0,128))/128;
     voice[i].levelL=(map(tracklevel[i],0,1000,0,128)*map(trackpan[i],-1000,1000,128,0))/128;
@@ -420,8 +448,8 @@ void init_voices(void) {
     voice[i].velocity=DEFAULT_LEVEL;
     voice[i].slices=0; // no slices
     // silence all voices by setting sampleindex to last sample
-    voice[i].sampleindex=sample[voice[i].sample].samplesize<<12; // sampleindex is a 20:12 fixed point number
-    voice[i].samplesize=sample[voice[i].sample].samplesize; // 
+    voice[i].sampleindex=sample[voice[i].playsample].samplesize<<12; // sampleindex is a 20:12 fixed point number
+    voice[i].samplesize=sample[voice[i].playsample].samplesize; // 
   } 
 }
 
@@ -430,7 +458,7 @@ ClickEncoder Encoder1(ENC_A,ENC_B,ENC_SW,4); // divide by 4 works best with my e
 
 // interrupt timer defs
 #define ENC_TIMER_MICROS 250 // 4khz for encoder
-#define SEQ_INTERVAL ((1000/ENC_TIMER_MICROS)*5)  // update sequencers every 5 ms - 300bpm is 20 steps per second=50ms
+#define SEQ_INTERVAL 1  // run the transport on every interrupt - it works out which ticks are due from the microsecond timer
 // Init RPI_PICO_Timer
 //RPI_PICO_Timer ITimer(0);
 
@@ -462,7 +490,16 @@ static void alarm_irq(void) {
   alarm_in_us_arm(ENC_TIMER_MICROS);  // reschedule interrupt
 }
 
+#include "transport.h" // to avoid forward references
 #include "loadwav.h" // to avoid forward references
+#include "samplecache.h" // to avoid forward references
+#include "sampleheap.h" // to avoid forward references
+#include "onsets.h" // to avoid forward references
+#include "loader.h" // to avoid forward references
+#include "patterngen.h" // to avoid forward references
+#include "groove.h" // to avoid forward references
+#include "undo.h" // to avoid forward references
+#include "capture.h" // to avoid forward references
 #include "seq_editor.h" // to avoid forward references
 #include "menusystem.h" // to avoid forward references
 
@@ -515,31 +552,44 @@ uint32_t seqtime(void) {
 // *** note this runs in the interrupt when we call dosequencers()
 void step_pos(int current, int last) {
 
-  if (current == steps[sequencer]-1) { 
-    clip_complete |= _BV(sequencer); // set flag if on last step
+  if (sequencer == track) current_step=current; // this triggers display update in loop() for the current track  
+
+  if ((patmode[sequencer] == PATMODE_GEN) && (playscene[sequencer] != CLIP_STOPPED)) { // generative track - work out the pattern for this step now
+    uint8_t pitch,velocity;
+    if ((current == 0) && rerandomize[sequencer]) { // new variation every loop
+      pitchseed[sequencer]=nextseed(pitchseed[sequencer]);
+      velocityseed[sequencer]=nextseed(velocityseed[sequencer]);
+    }
+    if (genstep(sequencer,current,&pitch,&velocity)) playnote(sequencer,pitch,velocity,0);
   }
-  else clip_complete &= ~(_BV(sequencer)); // clip_complete is used to determine when all clips are on last step - for song mode
+}
 
-  if (sequencer == track) current_step=current; // this triggers display update in loop() for the current track  
+// start a note playing on a track's voice
+// low 16 bits of the command are the number of samples to wait before starting it so sequenced notes are sample accurate
+// lock is the note's sample lock - core1 looks it up when the note starts
+// *** runs in the timer interrupt
+void playnote(byte track, byte note, byte velocity, byte lock) {
+  voice[track].note=note; // save note for this voice
+  voice[track].velocity=velocity;
+  voice[track].lock=lock;
+  rp2040.fifo.push(((0x90 | track)<<24) | (velocity <<16) | notedelay());  // tell other core to play this voice  
 }
 
 // the callback that will be called by the sequencer when it needs to play notes
 // note that every sequencer uses this same callback 
 // high nybble of channel = scene, low nybble = track
 // each track's sequencer holds all the notes (clips) for all scenes on that track
-// the sequencers play recorded notes from all scenes but we only sound notes from the current scene
+// the sequencers play recorded notes from all scenes but we only sound notes from the scene launched on that track
 // originally I used a sequencer for every clip but its a lot of overhead
 // *** note this runs in the interrupt when we call dosequencers()
-void step_play(byte channel, byte command, byte arg1, byte arg2) {
+void step_play(byte channel, byte command, byte arg1, byte arg2, byte lock) {
   byte track=channel & 0xf;   // recorded track
   byte s=(channel & 0xf0)>>4; // recorded scene 
 
-  if (s == scene) {
+  if (s == playscene[track]) {
     switch (command) {
       case 0x9:  // note on
-        voice[track].note=arg1; // save note for this voice
-        voice[track].velocity=arg2;
-        rp2040.fifo.push(((0x90 | track)<<24) | (arg2 <<16));  // tell other core to play this voice  
+        playnote(track,arg1,arg2,lock);
         break;
       case 0x8: // note off - do nothing
         break;
@@ -549,18 +599,26 @@ void step_play(byte channel, byte command, byte arg1, byte arg2) {
 
 // stop all sequencers
 void stop_sequencers(void) {
+  noInterrupts();
+  transportstop();
   for (int8_t i=0; i< NTRACKS;++i)  seq[i].stop();
+  interrupts();
 }
 
-// start all sequencers
+// start all sequencers from step 0 together with the transport
 void start_sequencers(void) {
+  noInterrupts();
   for (int8_t i=0; i< NTRACKS;++i)  seq[i].start();
+  transportstart();
+  captureclear(); // tick count starts again so old pad history is no use
+  interrupts();
 }
 
 // menu callback functions
 // set number of steps in current track from current bar setting
 void setsteps(void) {
   seq[track].setSteps(steps[track]); // fixed at 16 beats per bar
+  makefill(track); // euclidean fill is spread over the whole track
 //  play_mode=false;  // stop playing - starting up will restart all sequencers so everything stays in sync
 //  stop_sequencers();
   start_sequencers(); // restart the sequencers to keep tracks in sync
@@ -577,45 +635,80 @@ void setlevels() {
 // menu callback -set all tracks to the same tempo
 void settempo(void) {
   for (int8_t i=0; i< NTRACKS;++i)  seq[i].setTempo(bpm);
+  settransporttempo(bpm);
+}
+
+// menu callback - set groove for current track
+void setgroove(void){
+  applygroove(track); 
+}
+
+// menu callback - make the user groove from the current clip
+void getgrooveclip(void) {
+  if (getgroove !=0) makegroove(track,scene);
+  getgroove=0;
 }
 
-// menu callback - set shuffle amount for current track
-void setshuffle(void){
-  seq[track].setShuffle(shuffle[track]); 
+// menu handler for the memory view - the values are only for show so put them back
+void showmemory(void) {
+  heapstats();
 }
 
+// menu handler to compact the sample heap - serviceload() does it a slice at a time
+// not while a sample is loading - it has heap blocks that aren't on a track yet
+void defragheap(void) {
+  if ((defrag !=0) && !loadjob.busy && !heapcompacting()) heapcompactstart();
+  defrag=0;
+}
 
+// change the step length of the current track
+// the clip is relaunched so it starts again in step with the other tracks on the next launch point
+void setdivision(void) {
+  seq[track].setTicksPerStep(trackticks(track));
+  if (playscene[track] != CLIP_STOPPED) launchclip(track,playscene[track]);
+}
+
+// change the time signature - sets the bar length for the song, clip launching and the display
+void settimesig(void) {
+  stepsperbar=timesigbeats[timesig]*16/timesigunit[timesig];
+}
+
+
+
+// fill a clip buffer with the pattern generator output for track t
+// works like paste - keep repeating the pattern till the clip is full
+void makepattern(int16_t t, SixteenStepNote *clip) {
+  for (int n=0; n < steps[t]; ++n) {
+    clip[n]=DEFAULT_NOTE;
+    genstep(t,n,&clip[n].pitch,&clip[n].velocity);
+  }
+}
 
 // menu callback - set pattern for current track
-// works like paste - keep repeating till scene steps are full
+// the clip is built off to the side and replaces the old one in a single write so the sequencer never sees a half written clip
+// generative tracks don't use the clip - the pattern is worked out as the sequencer plays
 void setpattern(void){
-  uint16_t pat,mask;
-  int16_t s;
-  seq[track].removeNotes(scene <<4 | track); // clear scene contents
-  pat=rightRotate(patshift[track],drumpatterns[pattern[track]],STEPS_PER_BAR); // rotate the pattern per the menu setting
-//  Serial.printf("%4x\n",pat);
-  s=0;
-  mask=0x8000;
-  for (int n=0; n < steps[track]; ++n) {
-    if ((pat & mask) !=0) { 
-      if (voice[track].slices !=0) seq[track].setNote(n,scene <<4 | track,MIDDLE_C+pitchoffsets[track][n],DEFAULT_LEVEL+velocityoffsets[track][n]); // if pattern bit is set insert slice number
-      else seq[track].setNote(n,scene <<4 | track,padtoMIDI[current_scale][pitchremap[pitchoffsets[track][n]]],DEFAULT_LEVEL+velocityoffsets[track][n]); // else insert note from current scale
-      
-  //    int8_t velocityoffset=constrain(random(-(patvelocity[track]*4),patvelocity[track]*4),0,127);  // generate a random velocity offset
-  //    if (voice[track].slices !=0) seq[track].setNote(n,scene <<4 | track,MIDDLE_C+random(0,patpitch[track]+1),DEFAULT_LEVEL+velocityoffset); 
-      // else insert note from current scale
-  //    else seq[track].setNote(n,scene <<4 | track,padtoMIDI[current_scale][pitchremap[random(0,patpitch[track]+1)]],DEFAULT_LEVEL+velocityoffset); 
-    }
-    mask=mask>>1;
-    ++s;
-    if (s == STEPS_PER_BAR) {
-      s=0; // end of pattern, repeat
-      mask=0x8000;
-    }
+  makefill(track);
+  if (patmode[track] == PATMODE_CLIP) {
+    undoclip(track,scene); // turning a pattern knob is one undo step
+    makepattern(track,patternbuffer);
+    seq[track].setClip(scene <<4 | track,patternbuffer,steps[track]); 
+    undoend();
   }
   showpattern(track); 
 }
 
+// menu callback - switch current track between pattern clips and generative patterns
+// going generative clears the pattern from the clip, going back writes the current pattern into the clip
+void setpatmode(void){
+  if (patmode[track] == PATMODE_GEN) {
+    undoclip(track,scene);
+    seq[track].clearClip(scene <<4 | track); 
+    undoend();
+  }
+  setpattern();
+}
+
 // update display to show sequencer position
 void showposition (int16_t position) {
   display.setCursor(0,DISPLAY_Y_OFFSET);
@@ -632,7 +725,17 @@ void showposition (int16_t position) {
     display.printf("EDIT %d",editcursorX+1);
     if ((editnote <= HIGHEST_NOTE) && (editnote >= LOWEST_NOTE)) {
       display.setTextColor(GREEN,BLACK);
-      display.printf(" %d  ",editnote);
+      if (shiftkey && (currtouched & TRACK_BUTTON)) { // sample lock
+        if (editlock == 0) display.printf(" P-- ");
+        else display.printf(" P%-3d",editlock);
+      }
+      else if (shiftkey) display.printf(" %d%% ",100*(16-FS_TRIG_SKIP(edittrig))/16); // chance the note plays
+      else if (currtouched & SCENE_BUTTON) display.printf(" %s",trignames[FS_TRIG_CONDITION(edittrig)]);
+      else if (currtouched & TRACK_BUTTON) {
+        if (editratchet == 0) display.printf(" x1   ");
+        else display.printf(" x%d%c  ",FS_RATCHET_COUNT(editratchet),ratchetcurves[FS_RATCHET_CURVE(editratchet)]);
+      }
+      else display.printf(" %d  ",editnote);
     }
     else display.printf("      ");  // erases old shit if its there
     display.setTextColor(WHITE,BLACK); // foreground, background 
@@ -649,7 +752,8 @@ void showposition (int16_t position) {
  //     display.setCursor(95,0);
  //     display.print("   ");
   display.setCursor(128,DISPLAY_Y_OFFSET);
-  display.printf("%d:%d ", position/STEPS_PER_BAR+1,position%STEPS_PER_BAR+1);  // bar:step display 
+  int32_t tick=(int32_t)position*trackticks(track); // where this step is in the bar of the time signature
+  display.printf("%d:%d ", tick/barticks()+1,(tick%barticks())/trackticks(track)+1);  // bar:step display 
   uint32_t pos;
   pos= (position+1)*160/(steps[track]); // sequencer position bar
   display.drawRect(0, 15,pos,2, YELLOW);
@@ -657,150 +761,81 @@ void showposition (int16_t position) {
 //  display.display();
 }
 
-// create random pitch offsets to add to pattern
+// new random pitch offsets to add to pattern
 void pitchrandomizer(void) {  
-  for (uint16_t i=0;i<MAX_STEPS;++i) pitchoffsets[track][i]=random(0,patpitch[track]+1);
+  pitchseed[track]=newseed();
   setpattern();
 }
 
-// create random velocity offsets to add to pattern
+// new random velocity offsets to add to pattern
 // offsets add and subtract from default velocity level of 64
 void velocityrandomizer(void) {
-  for (uint16_t i=0;i<MAX_STEPS;++i) velocityoffsets[track][i]=constrain(random(-(patvelocity[track]*4),patvelocity[track]*4),0,128);
+  velocityseed[track]=newseed();
   setpattern();
 }
 
 
 // process sequencers - must be called frequently to keep the sequencers running.
-// we also process song mode here
 // Oct 14/24 **** changed to run under interrupts for accurate timing
 // the sequencer library was also modded to disable interrupts during note writes
+// the sequencers are clocked by the master transport which also handles song mode on the bar lines
 void dosequencers(void) {
   seqmillis=millis(); // freeze current time while we run the sequencers so they stay in sync
-  for (sequencer=0; sequencer< NTRACKS; ++sequencer) seq[sequencer].run();
-
-  if ((clip_complete == CLIPS_COMPLETE) && song_mode) {  // all clips complete
-    --scenecounter; // count down scene repeats
-    clip_complete=0;
-    //Serial.printf("scenecounter %d \n",scenecounter);
-    if (scenecounter <=0) { 
-      ++scene;
-      if (scene >= NSCENES) scene=0; // back to start of song
-      while (scenecount[scene]==0) { // skip over unused scenes
-        ++scene;
-        if (scene >= NSCENES) scene=0; // back to start of song
-      }
-//      if (scene == 0) allnotesoff(); // back to beginning of song so silence all notes 
-      //Serial.printf("advance to scene %d \n",scene);
-//      allnotesoff(); // silence all notes for new scene **** causes a crash now that its running in an interrupt
-      scenecounter=scenecount[scene];
-    }
-  }
-
+  transportrun();
 }
 
-// save all the notes in track, scene to the clip buffer
+// save a snapshot of the notes in track, scene to the clipboard
+// the snapshot is shared with the undo history so copying doesn't use more memory unless the clip changes
 void copyclip(int16_t track, int16_t scene) {
-  SixteenStepNote * p;
-  for (int n=0; n < steps[track]; ++n) {
-    p=seq[track].getNote(n,scene <<4 | track); // retrieve notes by channel
-    memcpy(&clipbuffer[n],p,sizeof(SixteenStepNote));
-  }
-  clipbuffercnt=steps[track]; // keep size because paste destination may not be the same
+  releasesnap(copiedclip);
+  copiedclip=takesnap(track,scene);
 }
 
-// paste the notes in the clip buffer to track, scene
+// paste the notes in the clipboard to track, scene
 // if src clip smaller than dest clip, repeat paste till dest clip full
 void pasteclip(int16_t track, int16_t scene) {
-  SixteenStepNote * p;
-  int16_t s;
-  s=0;
-  for (int n=0; n < steps[track]; ++n) {
-    seq[track].setNote(n,scene <<4 | track,clipbuffer[s].pitch,clipbuffer[s].velocity); 
-    ++s;
-    if (s >= clipbuffercnt) s=0; // end of source clip, repeat
-  }
+  if (copiedclip == 0) return; // nothing copied yet
+  undobegin();
+  undosave(track,scene);
+  expandsnap(copiedclip,patternbuffer);
+  seq[track].pasteClip(scene <<4 | track,patternbuffer,copiedclip->length);
+  undoend();
   showpattern(track); 
 }
 
-// save all clips in scene to the scene buffer
+// save all clips in scene to the scene clipboard
 void copyscene( int16_t scene) {
-  SixteenStepNote * p;
   for (int track=0;track< NTRACKS;++track) {
-    for (int n=0; n < steps[track]; ++n) {
-      p=seq[track].getNote(n,scene <<4 | track); // retrieve notes by channel
-     // Serial.printf("step %2d ch %02X note %02X\n", n, p->channel,p->pitch);
-      memcpy(&scenebuffer[track][n],p,sizeof(SixteenStepNote));
-    }
+    releasesnap(copiedscene[track]);
+    copiedscene[track]=takesnap(track,scene);
   }
 }
 
-// paste the clips in the scene buffer to scene
+// paste the clips in the scene clipboard to scene
+// the whole scene paste is one undo step
 void pastescene(int16_t scene) {
-  SixteenStepNote * p;
+  undobegin();
   for (int track=0;track< NTRACKS;++track) {
-    for (int n=0; n < steps[track]; ++n) {
-      seq[track].setNote(n,scene <<4 | track,scenebuffer[track][n].pitch,scenebuffer[track][n].velocity); 
-    }
+    if (copiedscene[track] == 0) continue;
+    undosave(track,scene);
+    expandsnap(copiedscene[track],patternbuffer);
+    seq[track].pasteClip(scene <<4 | track,patternbuffer,copiedscene[track]->length);
   }
+  undoend();
   showpattern(track); 
 }
 
-// **** not working - doesn't move last note to first correctly
-// first note propagates forward properly
-// seems to be something about the way notes are allocated in setnote() during recording
-// I would have thought all the empty notes would be sorted to the end of memory but they are at the beginning
-// seems like a bug to me - you will allocate a new note before you find the old one to write over
-// Fifteenstep was written to be polyphonic ie multiple notes at same step and I'm using it monophonic so maybe thats the underlying issue
-
-/*
-// shift all notes in clip forward one step
-void shiftclipfwd(int16_t track, int16_t scene) {
-  FifteenStepNote * src, * dest, lastnote;
-  if (steps[track]==1) return; // nothing to do
-  src=seq[track].getNote(steps[track]-1,scene <<4 | track); // get last note
-//  Serial.printf("src pointer channel %d pitch %d velocity %d\n",src->channel,src->pitch,src->velocity );
-  memcpy(&lastnote,src,sizeof(FifteenStepNote)); // save it
-    Serial.printf("lastnote channel %d pitch %d velocity %d\n",lastnote.channel,lastnote.pitch,lastnote.velocity);
-  for (int n=steps[track]-1; n > 0; --n) { // start at end and copy n-1 to n
-    src=seq[track].getNote(n-1,scene <<4 | track); // get source note pointer
-    seq[track].setNote(n,src->channel,src->pitch,src->velocity); 
- //   dest=seq[track].getNote(n,scene <<4 | track); // get destination pointer
- //   memcpy(dest,src,sizeof(FifteenStepNote)); // ** use memcpy here. src may point to DEFAULT_NOTE ie empty step
-  }
-//  dest=seq[track].getNote(0,scene <<4 | track); // get pointer to first note
-//  memcpy(dest,&lastnote,sizeof(FifteenStepNote));  // copy last note to first position
-  seq[track].setNote(0,lastnote.channel,lastnote.pitch,lastnote.velocity);
- // src=seq[track].getNote(0,scene <<4 | track);
- // Serial.printf("firstnote channel %d pitch %d velocity %d\n",src->channel,src->pitch,src->velocity );
-  seq[track].dumpNotes();
-}
-
-// **** broken - causes a crash. once I get above working fix this
-// shift all notes in clip back one step
-void shiftclipback(int16_t track, int16_t scene) {
-  FifteenStepNote * src, *dest, firstnote;
-  if (steps[track]==1) return; // nothing to do
-  src=seq[track].getNote(0,scene <<4 | track); // get first note
-  memcpy(&firstnote,src,sizeof(FifteenStepNote)); // save it
-  for (int n=0; n < steps[track]-1; ++n) { // start at beginning and copy n+1 to n
-    src=seq[track].getNote(n+1,scene <<4 | track); // get source note pointer
-    dest=seq[track].getNote(n,scene <<4 | track); // get destination pointer
-    memcpy(dest,src,sizeof(FifteenStepNote)); // ** use memcpy here. src may point to DEFAULT_NOTE ie empty step
-   // seq[track].setNote(n,scene <<4 | track,src->pitch,src->velocity); 
-  }
-  dest=seq[track].getNote(steps[track]-1,scene <<4 | track); // get pointer to last note
-  memcpy(dest,&firstnote,sizeof(FifteenStepNote)); // copy first note to last position
-  // seq[track].setNote(steps[track]-1,scene <<4 | track,firstnote.pitch,firstnote.velocity);  // copy last note to first position
-}
-
-
 // menu callback function to shift clip
+// each encoder click moves the notes in the current clip one step, shift goes back to 0 so it can be turned again
 void shiftclip(void) {
-  if (shift == 1) shiftclipfwd(track,scene);
-  else if (shift == -1)shiftclipback(track,scene);
+  if (shift !=0) {
+    undoclip(track,scene);
+    seq[track].rotateClip(scene <<4 | track,shift);
+    undoend();
+  }
+  shift=0;
+  showpattern(track); 
 }
-*/
 
 // main core setup
 void setup() {
@@ -899,7 +934,9 @@ void setup() {
   display.fillScreen(BLACK);
 // initialize the sample and voice data structures
   init_samples();
+  heapinit();
   init_voices();
+  initgrooves();
 
 /* no MIDI for now	
 //  Set up serial MIDI port
@@ -925,13 +962,16 @@ void setup() {
     seq[i].setMidiHandler(step_play);
     seq[i].setStepHandler(step_pos);
     seq[i].setTimeHandler(seqtime);
+    seq[i].setTicksPerStep(trackticks(i)); // clocked by the transport
+    seq[i].setSeed(0x9E3779B9*(i+1)); // so trig chances on different tracks don't line up
+    applygroove(i);
+    setplayscene(i,scene);
   }
+  settransporttempo(bpm);
+  compilesong();
+  start_sequencers();
 
-  for (int t=0; t< NTRACKS; ++t) {  // make sure we start off with no random offsets
-    for (int i=0; i< MAX_STEPS;++i) {
-      velocityoffsets[t][i]=pitchoffsets[t][i]=0; 
-    }
-  }
+  seedstate^=micros(); // different variations every time we start up
   // start up the timer interrupt
   alarm_in_us(ENC_TIMER_MICROS);
 }
@@ -941,12 +981,16 @@ void setup() {
 void loop() {
   float pitch, retune;
   static uint32_t recbutton_timer,transportbutton_timer;
-  static bool trackerased,startsongmode;
+  static bool trackerased,startsongmode,captured,fillmode;
 
 
   if (edit_mode) editnotes();  // note editor needs encoder so its mutually exclusive from menus
   else  domenus();
 
+// load samples a slice at a time so the UI and sequencers keep going - show the new name if its on screen
+  if (serviceload() && !edit_mode && (topmenuindex < NTRACKS) && ((uistate == SUBSELECT) || (uistate == PARAM_INPUT))
+    && (topmenu[topmenuindex].submenuindex < SUBMENU_LINES)) drawsubmenu(0);
+
   // first 16 menu pages are track/voice settings which have extra elements on screen
   if (topmenuindex < NTRACKS) {
     track = topmenuindex; // map menu index to track/voice number
@@ -960,42 +1004,31 @@ void loop() {
     }
   }
 
-// re-randomize at end of scene if user has selected to in menus
-  if (clipflags!=clip_complete) {  
-    uint16_t clips=clip_complete;  // bitmap of clips that just completed
-    for (int16_t t=0; t<NTRACKS; ++t) {
-      if ((clips & 1) && rerandomize[t] ) {  // find clips that just ended
-        for (int16_t s=0;s<steps[t];++s) {
-          pitchoffsets[t][s]=random(0,patpitch[t]+1);
-          velocityoffsets[t][s]=constrain(random(-(patvelocity[t]*4),patvelocity[t]*4),0,128);
-        }
-        uint16_t pat,mask;  // this is just a copy of setpattern() code but it doesn't use the "track" global
-        int16_t step;
-        seq[t].removeNotes(scene <<4 | t); // clear scene contents
-        pat=rightRotate(patshift[t],drumpatterns[pattern[t]],STEPS_PER_BAR); // rotate the pattern per the menu setting
-        step=0;
-        mask=0x8000;
-        for (int n=0; n < steps[t]; ++n) {
-          if ((pat & mask) !=0) { 
-            if (voice[t].slices !=0) seq[t].setNote(n,scene <<4 | t,MIDDLE_C+pitchoffsets[t][n],DEFAULT_LEVEL+velocityoffsets[t][n]); // if pattern bit is set insert slice number
-            else seq[t].setNote(n,scene <<4 | t,padtoMIDI[current_scale][pitchremap[pitchoffsets[t][n]]],DEFAULT_LEVEL+velocityoffsets[t][n]); // else insert note from current scale
-          }
-          mask=mask>>1;
-          ++step;
-          if (step == STEPS_PER_BAR) {
-            step=0; // end of pattern, repeat
-            mask=0x8000;
-          }
-        }
-        if (t == track)showpattern(track); 
+// re-randomize if user has selected to in menus
+// the next variation is built while the current loop plays and queued in the sequencer which swaps it in on step 0
+// the sequencers share a few spare buffers for queued clips so the tracks take turns, starting after the last one that got one
+// it is the clip the track is playing that changes, not the one on screen - stopped tracks are left alone
+  for (int16_t i=0; i<NTRACKS; ++i) {
+    int16_t t=(nextrandomtrack+i) % NTRACKS;
+    int8_t s=playscene[t];
+    if ((queuedclips & _BV(t)) && !seq[t].clipQueued()) { // queued clip has been swapped in (or cancelled by a clip edit)
+      queuedclips &= ~_BV(t);
+      if (t == track) showpattern(track); 
+    }
+    if (rerandomize[t] && (patmode[t] == PATMODE_CLIP) && (s != CLIP_STOPPED) && !(queuedclips & _BV(t)) && seq[t].canQueueClip()) {  // prepare the next loop - generative tracks do this in the sequencer
+      pitchseed[t]=newseed();
+      velocityseed[t]=newseed();
+      makepattern(t,patternbuffer);
+      if (seq[t].queueClip(s <<4 | t,patternbuffer,steps[t])) {
+        queuedclips |= _BV(t);
+        nextrandomtrack=(t+1) % NTRACKS;
       }
-      clips=clips>>1;
     }
-    clipflags=clip_complete; // so we wait for next change
   }
 
 // handle touch pad used for note entry, track and scene selection
 
+  uint32_t padmicros=micros(); // timestamp the pad scan so recorded notes go where they were played, not where loop() got to them
   currtouched = padA.touched() | (padB.touched()<<(NPADS/2)); // combine both pads
 
 // process the edit key
@@ -1015,6 +1048,13 @@ void loop() {
   if (currtouched & SHIFT_BUTTON) shiftkey=true;
   else shiftkey=false;
 
+// hold shift + scene for fills - FILL trigs play and NOT FILL trigs don't
+  bool fill=shiftkey && (currtouched & SCENE_BUTTON) && !edit_mode;
+  if (fill != fillmode) {
+    for (int16_t t=0; t<NTRACKS; ++t) seq[t].setFill(fill);
+    fillmode=fill;
+  }
+
 // process play/stop/song mode button
   if ((currtouched & TRANSPORT_BUTTON) && !(lasttouched & TRANSPORT_BUTTON)) {  // transport button pressed, start timing
     transportbutton_timer=millis();
@@ -1026,11 +1066,8 @@ void loop() {
       if (song_mode) {
    //     play_mode=false; // stop playing  
         stop_sequencers(); // reset all sequencers to step 0
+        songseek(0);  // start at first bar of the song
         start_sequencers();
-        noInterrupts(); // scenes change in the ISR so stop it running
-        scene=0;  // start at first scene
-        scenecounter=scenecount[scene];
-        interrupts();
       }
       showposition(0); // update the screen in case sequencers are stopped
       startsongmode=true;      // so we only do this once per key hold
@@ -1047,17 +1084,26 @@ void loop() {
   if ((currtouched & RECORD_BUTTON) && !(lasttouched & RECORD_BUTTON)) {  // record button pressed, start timing
     recbutton_timer=millis();
     trackerased=false;
+    captured=false;
+    if (shiftkey && !edit_mode) { // shift-record captures what was just played on the pads
+      captureclip(track,scene);
+      if (topmenuindex < NTRACKS) showpattern(topmenuindex);
+      captured=true;  // so holding or releasing the button doesn't erase or toggle record
+    }
   }
   uint32_t recholdtime=millis()-recbutton_timer;
-  if ((currtouched & RECORD_BUTTON) && (recholdtime > RECBUTTON_HOLD_TIME) && !trackerased) { //record button held
-    seq[track].removeNotes(scene <<4 | track); //  hold record to clear scene
+  if ((currtouched & RECORD_BUTTON) && (recholdtime > RECBUTTON_HOLD_TIME) && !trackerased && !captured) { //record button held
+    undobegin();
+    undosave(track,scene);
+    seq[track].clearClip(scene <<4 | track); //  hold record to clear scene
+    undoend();
 //    allnotesoff(); // silence all notes that may have been playing
     trackerased=true; // if we keep erasing it causes audio noise
     if (topmenuindex < NTRACKS) showpattern(topmenuindex); // show the piano roll if this is a track menu
  //   Serial.printf("track erased\n");
   }
   if (!(currtouched & RECORD_BUTTON) && (lasttouched & RECORD_BUTTON)) {  // record button released   
-    if ( recholdtime < RECBUTTON_HOLD_TIME) {
+    if ((recholdtime < RECBUTTON_HOLD_TIME) && !captured) {
         record_mode=!record_mode;
     }
     showposition(0);  // update the screen in case sequencers are stopped
@@ -1066,13 +1112,21 @@ void loop() {
 
 // process copy button
   if ((currtouched & COPY_BUTTON) && !(lasttouched & COPY_BUTTON)) {  // copy button pressed
-    if (currtouched & SCENE_BUTTON) copyscene(scene);
+    if (shiftkey) { // shift-copy is undo
+      undo();
+      showpattern(track);
+    }
+    else if (currtouched & SCENE_BUTTON) copyscene(scene);
     else copyclip(track,scene);  
   }
 
 // process paste button
   if ((currtouched & PASTE_BUTTON) && !(lasttouched & PASTE_BUTTON)) {  // paste button pressed
-    if (currtouched & SCENE_BUTTON) pastescene(scene);
+    if (shiftkey) { // shift-paste is redo
+      redo();
+      showpattern(track);
+    }
+    else if (currtouched & SCENE_BUTTON) pastescene(scene);
     else pasteclip(track,scene);  
   }
 
@@ -1083,6 +1137,16 @@ void loop() {
   }
 */
 
+#ifdef FS_MEASURE_LOCK_TIME  // report the longest time a sequencer note write had interrupts disabled
+  static unsigned long maxlock;
+  for (int t=0; t<NTRACKS; ++t) {
+    if (seq[t].getMaxLockTime() > maxlock) {
+      maxlock=seq[t].getMaxLockTime();
+      Serial.printf("track %d interrupts off %lu us\n",t,maxlock);
+    }
+  }
+#endif
+
 // process number pads - note entry, track and scene select etc
   for (uint8_t i=0; i<NPADS; i++) { // have to scan all the pads because they are not in order
     if (padmap[i] < 16) { // process just the number pads
@@ -1090,9 +1154,18 @@ void loop() {
        // Serial.printf("numpad %d curtouched %04x %02x\n",padmap[i],currtouched, padA.touched());
         if ((currtouched & SCENE_BUTTON) && (!(currtouched & COPY_BUTTON)) && (!(currtouched & PASTE_BUTTON))) {
          // Serial.printf("scene \n");
-          if (!edit_mode) scene=padmap[i];  // scene button + pad = change scene
+          if (!edit_mode) {
+            scene=padmap[i];  // scene button + pad = change scene
+            launchscene(scene); // whole row starts on the next launch point
+          }
           showpattern(track); // update piano roll for this scene
         }
+        else if (shiftkey && (!edit_mode)) { // shift + pad = launch or stop a clip on the current track
+          if ((playscene[track] == padmap[i]) && (launchqueue[track] == LAUNCH_NONE)) launchclip(track,CLIP_STOPPED); // playing clip stops
+          else launchclip(track,padmap[i]);
+          scene=padmap[i];  // show the clip
+          showpattern(track);
+        }
         // else if ((currtouched & TRACK_BUTTON) && (!edit_mode)) { // track button + pad = change track
         else if ((padA.touched() & TRACK_BUTTON) && (!edit_mode)) { // track button + pad = change track
        // Serial.printf("track %d\n",padmap[i]);
@@ -1114,9 +1187,16 @@ void loop() {
           }
       // if recording, save note on
           if(record_mode) {
-            seq[track].setNote(scene <<4 | track, voice[track].note, DEFAULT_LEVEL); // record note with fixed velocity
+            undoclip(track,scene); // a run of recorded notes is one undo step
+            seq[track].recordNote(scene <<4 | track, voice[track].note, DEFAULT_LEVEL, ticksago(padmicros), recquantize); // record note with fixed velocity
+            undoend();
+#ifdef MEASURE_RECORD_TIME
+            Serial.printf("rec: scan to record %lu us\n",(unsigned long)(micros()-padmicros));
+#endif
           //seq[track].dumpNotes();
           }  
+          if (transportrunning) captureevent(track,voice[track].note,DEFAULT_LEVEL,padmicros); // always keep a history of what was played
+          voice[track].lock=0; // pads play the track's sample
           rp2040.fifo.push(((0x90 | track)<<24) | (DEFAULT_LEVEL <<16));  // tell other core to play this voice  
           showpattern(track);      
         }
@@ -1152,49 +1232,84 @@ void setup1() {
 delay (1000); // wait for main core to start up peripherals
 }
 
+// start a voice playing from the start of its sample or slice
+// the sample is picked here once per note so the mix loop doesn't have to look at sample locks
+void startvoice(int16_t track) {
+  float pitch, retune;
+  int16_t s=voice[track].sample;
+  uint8_t lock=voice[track].lock;
+  if ((lock != 0) && (lock <= LOCK_SLOTS) && (locksample[lock-1] >= 0)) s=locksample[lock-1]; // empty slot plays the track's sample
+  voice[track].playsample=s;
+  struct sample_t *smp=&sample[s];
+  if ((voice[track].slices != 0) && (smp->slicecount > 1)) { // slice at the hits found when the sample was loaded
+    uint8_t slices=min((uint8_t)voice[track].slices,smp->slicecount);
+    uint8_t slicenumber=(uint8_t)(voice[track].note-MIDDLE_C) % slices;
+    voice[track].sampleindex=smp->slice[slicenumber]<<12; // start of slice
+    voice[track].samplesize=(slicenumber+1 < smp->slicecount) ? smp->slice[slicenumber+1] : smp->samplesize; // runs to the next hit
+    pitch=(float)pitchtable[MIDDLE_C];
+  }
+  else if (voice[track].slices != 0) { // slice mode playback added 8/15/24
+    uint32_t slicesize=(uint32_t)sample[s].samplesize/(uint32_t)(voice[track].slices); // calculate slice size
+    uint8_t slicenumber=(uint8_t)(voice[track].note-MIDDLE_C) % (uint8_t)(voice[track].slices); // modulo so we don't index off the end of the sample       
+    voice[track].sampleindex=(slicesize*slicenumber)<<12; // calculate start of slice
+    voice[track].samplesize=slicesize*(slicenumber+1); // calculate end of slice
+    pitch=(float)pitchtable[MIDDLE_C];      
+  }
+  else { // normal pitched playback of sample
+    voice[track].samplesize=sample[s].samplesize; // reset samplesize since we might have just come from slice mode
+    pitch=(float)pitchtable[voice[track].note];
+    voice[track].sampleindex=0; // start of sample
+  }
+  retune=(float)voice[track].tune/1000; // tune is integer because of menu system, 1000= 1.000
+  retune=powf(2,retune/12); // calculate pitch retuning
+  voice[track].sampleincrement=(uint32_t)(pitch*retune);
+}
+
 // look up samples, interpolate and send to DAC
 void loop1(){
   int32_t newsample,samplesumL,samplesumR;
   uint32_t index;
   int16_t samp0,samp1,delta,track,tracksample;
   uint32_t command;
-  float pitch, retune;
   uint8_t velocity;
+  uint16_t delay;
 
+  heappaused=heappause; // let core0 know we won't read a sample it is moving
 // July 2024 changed to interprocessor command FIFO. old scheme of both processors modifying sampleindex is not multicore safe
 // this scheme sends note on messages from core1 to core2 via the fifo
 // we don't care about note offs - just let the sample play thru
   while (rp2040.fifo.available()) { // get MIDI command, channel# = voice#
     command=rp2040.fifo.pop(); //
     track=(command>>24) & 0xf; 
-    command= (command>>24) & 0xf0;  
     velocity=(command >>16) & 0x7f;
+    delay=command & 0xffff;
+    command= (command>>24) & 0xf0;  
     switch (command) {
       case 0x90: // note on
-        if (voice[track].slices != 0) { // slice mode playback added 8/15/24
-          uint32_t slicesize=(uint32_t)sample[voice[track].sample].samplesize/(uint32_t)(voice[track].slices); // calculate slice size
-          uint8_t slicenumber=(uint8_t)(voice[track].note-MIDDLE_C) % (uint8_t)(voice[track].slices); // modulo so we don't index off the end of the sample       
-          voice[track].sampleindex=(slicesize*slicenumber)<<12; // calculate start of slice
-          voice[track].samplesize=slicesize*(slicenumber+1); // calculate end of slice
-          pitch=(float)pitchtable[MIDDLE_C];      
-        }
-        else { // normal pitched playback of sample
-          voice[track].samplesize=sample[voice[track].sample].samplesize; // reset samplesize since we might have just come from slice mode
-          pitch=(float)pitchtable[voice[track].note];
-          voice[track].sampleindex=0; // start of sample
+        if (delay == 0) startvoice(track);
+        else {  // sequenced notes wait so they start exactly on their tick
+          voice[track].startdelay=delay;
+          delayedvoices|=_BV(track);
         }
-        retune=(float)voice[track].tune/1000; // tune is integer because of menu system, 1000= 1.000
-        retune=powf(2,retune/12); // calculate pitch retuning
-        voice[track].sampleincrement=(uint32_t)(pitch*retune); 
         break;
       case 0x80: // note off
+        delayedvoices&=~_BV(track); // cancel a note that hasn't started yet
       // silence voice by setting sampleindex to last sample
-        voice[track].sampleindex=sample[voice[track].sample].samplesize<<12; // sampleindex is a 20:12 fixed point number
-        voice[track].samplesize=sample[voice[track].sample].samplesize; //  
+        voice[track].sampleindex=sample[voice[track].playsample].samplesize<<12; // sampleindex is a 20:12 fixed point number
+        voice[track].samplesize=sample[voice[track].playsample].samplesize; //  
         break;
     }       
   }
 
+  if (delayedvoices) { // count down delayed notes - one sample per loop
+    for (int i=0; i< NUM_VOICES;++i) {
+      if ((delayedvoices & _BV(i)) && (--voice[i].startdelay == 0)) {
+        startvoice(i);
+        delayedvoices&=~_BV(i);
+      }
+    }
+  }
+
  // oct 22 2023 resampling code
 // to change pitch we step through the sample by .5 rate for half pitch up to 2 for double pitch
 // sample.sampleindex is a fixed point 20:12 integer:fraction number
@@ -1206,18 +1321,21 @@ void loop1(){
 
   samplesumL=samplesumR=0;
   for (int i=0; i< NUM_VOICES;++i) {  // look for samples that are playing, scale their volume, and add them up
-    tracksample=voice[i].sample; // precompute for a little more speed below
+    tracksample=voice[i].playsample; // precompute for a little more speed below
     index=voice[i].sampleindex>>12; // get the integer part of the sample increment
     if (index <= voice[i].samplesize) { // if sample is playing, do linear interpolation   
-      samp0=sample[tracksample].samplearray[index]; // get the first sample to interpolate
-      samp1=sample[tracksample].samplearray[index+1];// get the second sample
-      delta=samp1-samp0;
-      newsample=(int32_t)samp0+((int32_t)delta*((int32_t)voice[i].sampleindex & 0x0fff))/4096; // interpolate between the two samples
-      samplesumL+=(newsample*voice[i].levelL*voice[i].velocity)/16384; // use MIDI velocity levels 0-127 - have to scale down by 128*128 to avoid overflow
-      samplesumR+=(newsample*voice[i].levelR*voice[i].velocity)/16384; // using voice level, not the sample level
+      if (tracksample != heappaused) { // silent while core0 moves it but it keeps its place below
+        samp0=sample[tracksample].samplearray[index]; // get the first sample to interpolate
+        samp1=sample[tracksample].samplearray[index+1];// get the second sample
+        delta=samp1-samp0;
+        newsample=(int32_t)samp0+((int32_t)delta*((int32_t)voice[i].sampleindex & 0x0fff))/4096; // interpolate between the two samples
+        samplesumL+=(newsample*voice[i].levelL*voice[i].velocity)/16384; // use MIDI velocity levels 0-127 - have to scale down by 128*128 to avoid overflow
+        samplesumR+=(newsample*voice[i].levelR*voice[i].velocity)/16384; // using voice level, not the sample level
+      }
       voice[i].sampleindex+=voice[i].sampleincrement; // add step increment
     }
   }
+  ++mixepoch; // done with the samples for this mix - core0 frees retired samples by this count
 
  // samplesum=samplesum>>7;  // adjust for volume multiply above
 //  samplesumL=samplesumL>>7;  // adjust for volume multiply above 
@@ -0,0 +1,59 @@
+// retrospective capture
+// every note played on the keypad goes into a ring buffer with its transport tick whether we are recording or not
+// SHIFT+REC turns the last loop of the current track into a clip so you don't have to be recording when you play something good
+// loop() is the only writer and reader so no locking is needed - the oldest events are overwritten when it fills
+
+#define CAPTURE_EVENTS 256  // must be a power of 2 - 2K of RAM
+
+struct padevent {
+  uint32_t tick;      // transport tick when the pad was played
+  uint8_t track;
+  uint8_t pitch;      // 0 = unused slot
+  uint8_t velocity;
+};
+
+struct padevent capturering[CAPTURE_EVENTS];
+uint16_t capturehead=0;  // next slot to write - counts up and wraps with the mask
+
+// forget everything that was played - the transport restarted
+void captureclear(void) {
+  for (int i=0; i < CAPTURE_EVENTS; ++i) capturering[i].pitch=0;
+}
+
+// save a pad event - stamp is the micros() time of the keypad scan
+void captureevent(uint8_t t, uint8_t pitch, uint8_t velocity, uint32_t stamp) {
+  struct padevent *e=&capturering[capturehead & (CAPTURE_EVENTS-1)];
+  e->tick=tickcount-ticksago(stamp);
+  e->track=t;
+  e->pitch=pitch;
+  e->velocity=velocity;
+  ++capturehead;
+}
+
+// turn the pads played on track t during the last loop into clip t,sc
+// notes are placed the same way as live recording including the Rec Quantize setting
+// the clip is replaced in one write and can be undone
+void captureclip(int16_t t, int16_t sc) {
+  if (!transportrunning) return;
+  uint32_t now=tickcount;
+  uint32_t loopticks=steps[t]*trackticks(t);
+  bool found=false;
+  for (int n=0; n < steps[t]; ++n) patternbuffer[n]=DEFAULT_NOTE;
+  for (int i=0; i < CAPTURE_EVENTS; ++i) { // oldest first so the last note played on a step wins
+    struct padevent *e=&capturering[(capturehead+i) & (CAPTURE_EVENTS-1)];
+    if ((e->pitch == 0) || (e->track != t)) continue;
+    uint32_t ago=now-e->tick;
+    if (ago >= loopticks) continue;  // older than one loop or from before the transport restarted
+    int step,offset;
+    if (!seq[t].findStep(ago,recquantize,&step,&offset)) continue;
+    patternbuffer[step].pitch=e->pitch;
+    patternbuffer[step].velocity=e->velocity;
+    patternbuffer[step].offset=offset;
+    found=true;
+  }
+  if (!found) return;  // nothing played - leave the clip alone
+  undobegin();
+  undosave(t,sc);
+  seq[t].setClip(sc <<4 | t,patternbuffer,steps[t]);
+  undoend();
+}
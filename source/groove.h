@@ -0,0 +1,73 @@
+// groove templates
+// a groove moves each step of a track early or late and adds to its velocity
+// the track sequencers apply it as the transport clocks them so the timing is exact to 1/24 of a step and every loop is the same
+// swing grooves are MPC style - the swing % is where the second 16th of each 8th note pair lands, 50% is straight
+// timing offsets are in 24ths of a step so grooves work the same on tracks with any step division
+
+#define GROOVE_STEPS FS_MAX_GROOVE
+#define GROOVE_MAX_OFFSET (FS_GROOVE_RESOLUTION/2-1) // a step can move up to just under half a step
+enum grooves{GROOVE_OFF,GROOVE_SWING54,GROOVE_SWING58,GROOVE_SWING62,GROOVE_SWING66,GROOVE_SWING71,GROOVE_ACCENT,GROOVE_USER,NGROOVES};
+
+int8_t groovetiming[NGROOVES][GROOVE_STEPS];
+int8_t groovevelocity[NGROOVES][GROOVE_STEPS];
+int16_t groovelength[NGROOVES];
+
+// set up the stock grooves
+void initgrooves(void) {
+  const int8_t swingticks[]={2,4,6,8,10}; // 54 58 62 66 71% of an 8th note in 24ths of a 16th
+  const int8_t accent[]={16,-12,4,-12};   // velocity for the 4 16ths of a beat
+  for (int16_t g=0; g < NGROOVES; ++g) {
+    for (int16_t n=0; n < GROOVE_STEPS; ++n) groovetiming[g][n]=groovevelocity[g][n]=0;
+    groovelength[g]=0;
+  }
+  for (int16_t i=0; i < 5; ++i) {
+    groovetiming[GROOVE_SWING54+i][1]=swingticks[i]; // second 16th of each pair is late
+    groovelength[GROOVE_SWING54+i]=2;
+  }
+  for (int16_t n=0; n < 4; ++n) groovevelocity[GROOVE_ACCENT][n]=accent[n];
+  groovelength[GROOVE_ACCENT]=4;
+}
+
+// give track t its groove
+void applygroove(int16_t t) {
+  seq[t].setGroove(groovetiming[groove[t]],groovevelocity[groove[t]],groovelength[groove[t]]);
+}
+
+// make the user groove from the timing and velocity of the notes in clip t,sc
+// a note recorded more than half a step late is taken as the next step played early
+// steps without notes are left on the grid
+void makegroove(int16_t t, int16_t sc) {
+  int16_t len=min(steps[t],GROOVE_STEPS);
+  int8_t timing[GROOVE_STEPS],velocity[GROOVE_STEPS];
+  bool set[GROOVE_STEPS];
+  for (int16_t n=0; n < len; ++n) {
+    timing[n]=velocity[n]=0;
+    set[n]=false;
+  }
+  seq[t].getClip(sc <<4 | t,patternbuffer,steps[t]);
+  for (int16_t n=0; n < len; ++n) { // notes on or after their step
+    if (patternbuffer[n].pitch == 0) continue;
+    int16_t offset=patternbuffer[n].offset*FS_GROOVE_RESOLUTION/trackticks(t);
+    velocity[n]=constrain(patternbuffer[n].velocity-DEFAULT_LEVEL,-127,127);
+    if (offset > FS_GROOVE_RESOLUTION/2) continue;
+    timing[n]=min(offset,GROOVE_MAX_OFFSET);
+    set[n]=true;
+  }
+  for (int16_t n=0; n < len; ++n) { // notes played early show up late in the step before
+    if (patternbuffer[n].pitch == 0) continue;
+    int16_t offset=patternbuffer[n].offset*FS_GROOVE_RESOLUTION/trackticks(t);
+    int16_t next=(n+1) % len;
+    if ((offset <= FS_GROOVE_RESOLUTION/2) || set[next]) continue;
+    timing[next]=max(offset-FS_GROOVE_RESOLUTION,-GROOVE_MAX_OFFSET);
+    velocity[next]=velocity[n];
+    set[next]=true;
+  }
+  noInterrupts(); // tracks may be playing this groove
+  for (int16_t n=0; n < len; ++n) {
+    groovetiming[GROOVE_USER][n]=timing[n];
+    groovevelocity[GROOVE_USER][n]=velocity[n];
+  }
+  groovelength[GROOVE_USER]=len;
+  interrupts();
+  for (int16_t i=0; i < NTRACKS; ++i) if (groove[i] == GROOVE_USER) applygroove(i);
+}
@@ -0,0 +1,570 @@
+// background sample loading
+// loading a big .wav file takes a while so it is done a slice at a time from loop() while everything else keeps running
+// a load job is a list of samples - one picked in the file browser or a whole kit from a .KIT file
+// each sample goes to a slot - a track or one of the lock slots that notes can play with a sample lock
+// the tracks keep playing their old samples until the whole job is in PSRAM, then they are all swapped in one go
+// only one job runs at a time - starting another cancels the one in progress
+// a file that has been loaded before comes straight from its converted copy in the SD cache
+// a file that is already in the sample pool isn't loaded again - the slot just shares it
+// a sample that is no longer used isn't freed until core1 has finished with it - see retiresample()
+// the slice points are found as each sample streams in - see onsets.h
+// only the tracks play slices so only samples loaded for a track look for them and get a slice table
+
+#define LOAD_SLICE_MICROS 2000  // max time loop() spends loading each time around - a block read is well under this
+#define LOADBAR_HEIGHT 2        // progress bar across the top of the screen
+#define SAMPLE_PAD 2            // zeros after the end of a sample - core1 interpolates up to 2 samples past the last one
+#define LOAD_PATH 200           // longest sample path
+#define LOAD_ITEMS (NTRACKS+LOCK_SLOTS) // a sample for every slot
+#define LOAD_PATH_SPACE 16384   // for the paths of all the samples in a job - room for a full kit with paths averaging 64 chars
+#define SAMPLE_RETIRING -1      // refs of a sample that is waiting for core1 to let go of it
+#define SLICE_TABLES (3*NTRACKS) // the samples on the tracks, a kit loading new ones and the old ones waiting to retire
+
+struct loaditem {
+  int16_t slot;         // track 0-15 or NTRACKS+ lock slot
+  bool shared;          // already in the pool or loaded by another slot in the job - nothing to read
+  int16_t *buf;         // PSRAM for the new sample - 0 if the file couldn't be loaded or is shared
+  uint32_t size;        // samples
+  struct wavinfo wav;   // header read by loadstart() so loadopen() doesn't parse it again - the file size and modify date/time also stop a changed file being shared with its old copy
+  uint32_t pathhash;
+  uint32_t *slice;      // slice starts found by onsetfinish() - a table from the pool, 0 if none
+  uint8_t slicecount;
+  char *path;           // in loadjob.paths
+  int16_t newsample;    // sample[] the slot gets when the job is swapped in - -1 if none
+  int16_t oldsample;    // sample[] the slot had
+};
+
+struct loadjob {
+  bool busy;
+  bool failed;          // show the error bar next time around - the menus redraw the screen after starting a load
+  bool fromcache;       // reading a cache entry instead of converting the .wav
+  bool waiting;         // for the heap to be compacted before the PSRAM is allocated
+  bool compacted;       // the heap has been compacted for this job - if it still doesn't fit give up
+  int16_t count;        // samples in the job
+  int16_t current;      // sample loading now
+  int16_t barwidth;     // progress bar width drawn so far
+  int16_t pathspace;    // bytes of paths used
+#ifdef DEBUG
+  uint32_t start;       // for the load time report
+  uint32_t bytes;
+  uint32_t loaded;      // bytes that went through the onset detector
+#endif
+  struct loaditem item[LOAD_ITEMS];
+  char paths[LOAD_PATH_SPACE];
+} loadjob;
+
+// slice tables for the samples on the tracks
+// a table in every sample[] would cost more SRAM than the rest of the pool and most samples are one shots in lock slots
+// if they run out the sample plays equal slices like one with no hits found
+uint32_t slicetables[SLICE_TABLES][MAX_SLICES];
+bool slicetableused[SLICE_TABLES];
+
+// a free slice table or 0 if there are none
+uint32_t *slicealloc(void) {
+  for (int16_t i=0; i < SLICE_TABLES; ++i) {
+    if (slicetableused[i]) continue;
+    slicetableused[i]=true;
+    return slicetables[i];
+  }
+  return 0;
+}
+
+// give a slice table back to the pool - 0 is ignored
+void slicefree(uint32_t *slice) {
+  if (slice != 0) slicetableused[(slice-slicetables[0])/MAX_SLICES]=false;
+}
+
+// draw the load progress bar - only redrawn when it grows so it costs next to nothing
+void drawloadbar(int16_t percent) {
+  int16_t w=percent*display.width()/100;
+  if (w == loadjob.barwidth) return;
+  display.fillRect(0,0,w,LOADBAR_HEIGHT,GREEN);
+  display.fillRect(w,0,display.width()-w,LOADBAR_HEIGHT,BLACK);
+  loadjob.barwidth=w;
+}
+
+// the sample[] index a slot uses
+int16_t *slotsample(int16_t slot) {
+  if (slot < NTRACKS) return &voice[slot].sample;
+  return &locksample[slot-NTRACKS];
+}
+
+// a load failed - the slot keeps whatever it had but if it was a track with nothing the name says why
+void loaderror(int16_t slot, const char *message) {
+  if ((slot < NTRACKS) && (sample[voice[slot].sample].samplearray == 0)) strcpy(sample[voice[slot].sample].sname,message);
+  loadjob.failed=true;
+}
+
+// sample in the pool loaded from the same file as item or -1
+// the path is compared by its hash - with the same size and modify time as well a mix up is next to impossible
+// a track doesn't share a sample that didn't keep its slices
+int16_t findsample(struct loaditem *item) {
+  for (int16_t i=0; i < NUM_SAMPLES; ++i) {
+    struct sample_t *s=&sample[i];
+    if ((s->refs > 0) && (s->samplearray != 0) && (s->pathhash == item->pathhash) && (s->srcsize == item->wav.filesize)
+      && (s->srcdate == item->wav.date) && (s->srctime == item->wav.time) && (s->sliced || (item->slot >= NTRACKS))) return i;
+  }
+  return -1;
+}
+
+// unused sample in the pool or -1
+int16_t freesample(void) {
+  for (int16_t i=0; i < NUM_SAMPLES; ++i) if (sample[i].refs == 0) return i;
+  return -1;
+}
+
+// retired samples
+// core1 can be in the middle of a mix or starting a note with a sample when core0 takes it off its slot
+// so the PSRAM isn't freed right away - the sample goes on the retire list with the mix count core1 has to reach first
+// core1 counts mixepoch after every sample it mixes and never waits for core0 so playback can't glitch
+// once core1 has done a whole mix since the sample came off its slot no new note can start with it
+// any voice still playing it is told to stop and it is freed once that has happened
+struct retired {
+  int16_t sample;
+  uint32_t epoch;       // mixepoch to wait for
+};
+
+struct retired retirelist[NUM_SAMPLES];
+int16_t retirecount=0;
+volatile uint32_t mixepoch=0;  // only changed by core1
+
+// a slot has stopped using sample s - retire it if it was the last one
+void releasesample(int16_t s) {
+  if (--sample[s].refs > 0) return;
+  sample[s].refs=SAMPLE_RETIRING;  // so it isn't shared or reused while it waits
+  retirelist[retirecount].sample=s;
+  retirelist[retirecount].epoch=mixepoch+2;  // the mix core1 is doing now may have started before the swap - wait for the one after
+  ++retirecount;
+}
+
+// true if a voice is still playing sample s - it is told to stop
+bool sampleplaying(int16_t s) {
+  bool playing=false;
+  for (int16_t t=0; t < NUM_VOICES; ++t) {
+    if ((voice[t].playsample == s) && ((voice[t].sampleindex>>12) <= voice[t].samplesize)) {
+      rp2040.fifo.push((0x80 | t)<<24);  // note off
+      playing=true;
+    }
+  }
+  return playing;
+}
+
+// free the retired samples core1 has finished with
+// called from loop() - it never waits so it costs next to nothing
+// heap blocks can't be freed under a compaction so they wait till it is done
+void serviceretire(void) {
+  if (heapcompacting()) return;
+  for (int16_t i=0; i < retirecount; ) {
+    struct retired *r=&retirelist[i];
+    if ((int32_t)(mixepoch-r->epoch) < 0) {  // core1 hasn't got there yet
+      ++i;
+      continue;
+    }
+    if (sampleplaying(r->sample)) {  // check again once the note off has been through
+      r->epoch=mixepoch+2;
+      ++i;
+      continue;
+    }
+    struct sample_t *smp=&sample[r->sample];
+    if (smp->samplearray != 0) heapfree(smp->samplearray); // deallocate psram
+    smp->samplearray=0;
+    smp->samplesize=0;
+    smp->pathhash=0;
+    slicefree(smp->slice);
+    smp->slice=0;
+    smp->slicecount=0;
+    smp->sliced=false;
+    smp->refs=0;
+    *r=retirelist[--retirecount];  // the order doesn't matter
+  }
+}
+
+// free the PSRAM and slice tables of every sample in the job
+void loadfree(void) {
+  for (int16_t i=0; i < loadjob.count; ++i) {
+    if (loadjob.item[i].buf != 0) heapfree(loadjob.item[i].buf);
+    loadjob.item[i].buf=0;
+    slicefree(loadjob.item[i].slice);
+    loadjob.item[i].slice=0;
+  }
+}
+
+// stop the job in progress and throw away what was loaded
+void cancelload(void) {
+  if (!loadjob.busy) return;
+  if (loadjob.waiting) loadjob.waiting=false;  // nothing open yet - the compaction carries on by itself
+  else if (loadjob.fromcache) cache.close();
+  else {
+    wavclose();
+    cacheabort();
+  }
+  loadfree();
+  loadjob.busy=false;
+  drawloadbar(0);
+}
+
+// start building a new job - cancels the one in progress
+void loadclear(void) {
+  cancelload();
+  loadjob.count=0;
+  loadjob.pathspace=0;
+}
+
+// add a .wav file for a slot to the job being built
+// a slot that is already in the job gets the new file instead
+void loadadd(int16_t slot, char *path) {
+  int16_t i, len=strlen(path)+1;
+  if (loadjob.pathspace+len > LOAD_PATH_SPACE) return;
+  for (i=0; i < loadjob.count; ++i) if (loadjob.item[i].slot == slot) break;
+  if (i == loadjob.count) {
+    if (loadjob.count >= LOAD_ITEMS) return;
+    ++loadjob.count;
+  }
+  struct loaditem *item=&loadjob.item[i];
+  item->slot=slot;
+  item->shared=false;
+  item->buf=0;
+  item->slice=0;
+  item->slicecount=0;
+  item->path=loadjob.paths+loadjob.pathspace;
+  memcpy(item->path,path,len);
+  loadjob.pathspace+=len;
+  item->pathhash=pathhash(path);
+}
+
+// by path then slot so a track is loaded before a lock slot with the same file - the lock slot shares it with its slices
+int loaditemcomp(const void *a, const void *b) {
+  int c=strcmp(((struct loaditem *)a)->path,((struct loaditem *)b)->path);
+  return (c != 0) ? c : ((struct loaditem *)a)->slot-((struct loaditem *)b)->slot;
+}
+
+// open the file for the current sample and start reading it
+// the header loadstart() read is used again so the file is only opened once more and not parsed
+// returns false if the file has changed since the job started - the sample is dropped
+bool loadopen(void) {
+  struct loaditem *item=&loadjob.item[loadjob.current];
+  if ((uint32_t)wavreopen(item->path,&item->wav) != item->size) {
+    wavclose();
+    heapfree(item->buf);
+    item->buf=0;
+    loaderror(item->slot,"**File load error**");
+    return false;
+  }
+  loadjob.fromcache=cacheopen(item->path);
+  if (loadjob.fromcache) {
+    wavclose();
+    cachebegin(item->buf);
+  }
+  else {
+    wavbegin(item->buf);
+    cachecreate(item->path);  // save the converted samples for next time
+  }
+  onsetbegin();
+  return true;
+}
+
+// move on to the next sample in the job that can be opened
+// returns false when there are none left
+bool loadnext(void) {
+  while (++loadjob.current < loadjob.count) {
+    if ((loadjob.item[loadjob.current].buf != 0) && loadopen()) return true;
+  }
+  return false;
+}
+
+// put the loaded samples in the pool and in their slots and release the old ones
+// a sample is filled in before any slot points at it so the sequencer never starts a note with half of it
+// then core1 is told to stop the tracks so notes that started on the old samples don't carry on into the new ones
+// the pool always has room - the slots use at most LOAD_ITEMS samples and the job adds at most LOAD_ITEMS more
+// unless retired samples are still waiting for core1, which is over in a few mixes
+// returns the number of samples swapped in
+int16_t swapsamples(void) {
+  int16_t n=0;
+  for (int16_t i=0; i < loadjob.count; ++i) {
+    struct loaditem *item=&loadjob.item[i];
+    item->newsample=-1;
+    if (item->shared) {
+      item->newsample=findsample(item);
+      if (item->newsample < 0) loaderror(item->slot,"**File load error**");  // the copy it was sharing didn't load
+    }
+    else if (item->buf != 0) {
+      item->newsample=freesample();
+      if (item->newsample < 0) {  // only if retired samples haven't been freed yet
+        heapfree(item->buf);
+        item->buf=0;
+        slicefree(item->slice);
+        item->slice=0;
+        loaderror(item->slot,"**Memory error**");
+        continue;
+      }
+      struct sample_t *smp=&sample[item->newsample];
+      item->buf[item->size]=item->buf[item->size+1]=0;  // SAMPLE_PAD
+      heapown(item->buf,item->newsample);
+      smp->samplearray=item->buf;
+      smp->samplesize=item->size;
+      smp->srcsize=item->wav.filesize;
+      smp->srcdate=item->wav.date;
+      smp->srctime=item->wav.time;
+      smp->pathhash=item->pathhash;
+      smp->slice=item->slice;
+      smp->slicecount=item->slicecount;
+      smp->sliced=(item->slot < NTRACKS);
+      char *name=strrchr(item->path,'/');
+      strncpy(smp->sname,name ? name+1 : item->path,24); // copy first 24 chars of filename over
+      smp->sname[24]=0;
+      item->buf=0;  // belongs to the pool now
+      item->slice=0;
+    }
+    if (item->newsample >= 0) ++sample[item->newsample].refs;  // before any release so a sample moving between slots isn't freed
+  }
+  for (int16_t i=0; i < loadjob.count; ++i) {
+    struct loaditem *item=&loadjob.item[i];
+    if (item->newsample < 0) continue;
+    int16_t *s=slotsample(item->slot);
+    item->oldsample=*s;
+    *s=item->newsample;
+  }
+  for (int16_t i=0; i < loadjob.count; ++i) {
+    struct loaditem *item=&loadjob.item[i];
+    if (item->newsample < 0) continue;
+    if (item->slot < NTRACKS) rp2040.fifo.push((0x80 | item->slot)<<24);  // note off
+    if (item->oldsample >= 0) releasesample(item->oldsample);  // lock slots start empty
+    ++n;
+  }
+  return n;
+}
+
+// read the header of every file in the job
+// a file that can't be loaded gets a size of 0
+void loadheaders(void) {
+  for (int16_t i=0; i < loadjob.count; ++i) {
+    struct loaditem *item=&loadjob.item[i];
+    item->buf=0;
+    int32_t size=wavopen(item->path);  // reads the header and returns the .wav data size in words
+    wavclose();
+#ifdef DEBUG
+    Serial.printf("loading %s %d words\n",item->path,size);
+#endif
+    if (size <= 0) {
+      item->size=0;
+      loaderror(item->slot,"**File load error**");
+      continue;
+    }
+    item->size=size;
+    item->wav=wav;
+  }
+}
+
+// allocate PSRAM for the files in the job that aren't shared
+// all or nothing - returns the number of samples to swap in or -1 if they don't all fit
+int16_t loadalloc(void) {
+  int16_t n=0;
+#ifdef DEBUG
+  loadjob.bytes=0;
+#endif
+  for (int16_t i=0; i < loadjob.count; ++i) {
+    struct loaditem *item=&loadjob.item[i];
+    if (item->size == 0) continue;
+    item->shared=(findsample(item) >= 0);
+    if ((i > 0) && (strcmp(item[-1].path,item->path) == 0)) item->shared|=item[-1].shared || (item[-1].buf != 0); // same files are next to each other after the sort
+    if (item->shared) {
+      ++n;
+      continue;
+    }
+#ifdef DEBUG
+    loadjob.bytes+=item->wav.datasize;
+#endif
+    int16_t *p=(int16_t *)heapalloc((item->size+SAMPLE_PAD)*2);
+    if (p == 0) {
+      loadfree();
+      return -1;
+    }
+    item->buf=p;
+    ++n;
+  }
+  return n;
+}
+
+// allocate the PSRAM for the job and start loading it
+// if it doesn't fit the heap is compacted a slice at a time from serviceload() and this is called again when that is done
+// a job started while the heap is being compacted from the menu waits for that too
+// returns false if nothing can be loaded
+bool loadbegin(void) {
+  int16_t n=heapcompacting() ? -1 : loadalloc();
+  if (n < 0) {
+    if (!heapcompacting()) {
+      if (loadjob.compacted) {
+#ifdef DEBUG
+        Serial.printf("heapalloc failed\n");
+#endif
+        for (int16_t j=0; j < loadjob.count; ++j) loaderror(loadjob.item[j].slot,"**Memory error**");
+        return false;
+      }
+      heapcompactstart();  // try again with the free space in one piece
+      loadjob.compacted=true;
+    }
+    loadjob.waiting=true;
+    loadjob.busy=true;
+    loadjob.barwidth=-1;
+    drawloadbar(0);
+    return true;
+  }
+  loadjob.waiting=false;
+  if (n == 0) return false;
+  loadjob.current=-1;
+  if (!loadnext()) return swapsamples() > 0;
+  loadjob.busy=true;
+  loadjob.barwidth=-1;
+  drawloadbar(0);
+  return true;
+}
+
+// start the job built with loadadd()
+// the headers are all read and all the PSRAM allocated first so a kit that doesn't fit fails before anything is loaded
+// files that are already in the pool or in another slot in the job don't need PSRAM - if that is all of them they are swapped in right away
+// if it doesn't fit the heap is compacted and we try again before giving up
+// the files are loaded in path order so each directory is read in one go
+// returns false if nothing can be loaded - the slots keep their old samples
+bool loadstart(void) {
+  serviceretire();  // as much free PSRAM as there can be
+  qsort(loadjob.item,loadjob.count,sizeof(struct loaditem),loaditemcomp);
+#ifdef DEBUG
+  loadjob.start=micros();
+  loadjob.bytes=0;
+  loadjob.loaded=0;
+  onsetmicros=0;
+#endif
+  loadheaders();
+  loadjob.compacted=false;
+  return loadbegin();
+}
+
+// load a .wav file into the sample for track t
+// returns false if the file can't be loaded - the track keeps its old sample
+bool startload(int16_t t, char *path) {
+  loadclear();
+  loadadd(t,path);
+  return loadstart();
+}
+
+// true if a file name is a kit file
+bool iskit(char *name) {
+  int16_t len=strlen(name);
+  return (len > 4) && (strcasecmp(name+len-4,".KIT") == 0);
+}
+
+// load a kit file - a text file with a line for each track to load, the track number 1-16 then the path of the sample
+// lines starting with P load a lock slot instead, P1-P240, for notes with a sample lock to play
+// paths that don't start with / are in the same directory as the kit file, lines starting with # are comments
+// eg:
+// 1 Kicks/BD01.wav
+// 2 /Samples/Snares/SD03.wav
+// P1 Toms/TM01.wav
+bool loadkit(char *path) {
+  char line[LOAD_PATH], file[LOAD_PATH];
+  FsFile kit=sd.open(path);
+  if (!kit) return false;
+  loadclear();
+  char *slash=strrchr(path,'/');
+  int16_t dirlen=slash ? slash-path+1 : 0;  // keep the / on the end - no directory if there isn't one
+  while (kit.fgets(line,LOAD_PATH) > 0) {
+    char *p=line;
+    bool lock=(toupper(*p) == 'P');
+    if (lock) ++p;
+    int16_t t=strtol(p,&p,10)-1;
+    while ((*p == ' ') || (*p == '\t')) ++p;
+    int16_t len=strlen(p);
+    while ((len > 0) && (p[len-1] <= ' ')) p[--len]=0; // trim the line end and trailing spaces
+    if ((line[0] == '#') || (t < 0) || (t >= (lock ? LOCK_SLOTS : NTRACKS)) || (len == 0)) continue;
+    if (lock) t+=NTRACKS;
+    if (*p == '/') strcpy(file,p);
+    else {
+      if (dirlen+len >= LOAD_PATH) continue;
+      strncpy(file,path,dirlen);
+      strcpy(file+dirlen,p);
+    }
+    loadadd(t,file);
+  }
+  kit.close();
+  return loadstart();
+}
+
+// how far the job has got in %
+int16_t loadprogress(void) {
+  int16_t percent=loadjob.fromcache ? cacheprogress() : wavprogress();
+  return (loadjob.current*100+percent)/loadjob.count;
+}
+
+// find the slices of a track's sample once it has all been fed through onsetfeed() and keep them in a slice table
+void keepslices(struct loaditem *item) {
+  uint32_t slice[MAX_SLICES];
+  item->slicecount=onsetfinish(item->buf,item->size,slice);
+  if (item->slicecount < 2) return;  // equal slices
+  item->slice=slicealloc();
+  if (item->slice != 0) memcpy(item->slice,slice,sizeof(slice));
+  else item->slicecount=0;
+}
+
+// do the next slice of the job in progress and of a heap compaction
+// called from loop() - returns true when the samples have been swapped in so the caller can update the display
+bool serviceload(void) {
+  if (loadjob.failed) {
+    display.fillRect(0,0,display.width(),LOADBAR_HEIGHT,RED); // stays until the screen is redrawn
+    loadjob.barwidth=-1;
+    loadjob.failed=false;
+  }
+  serviceretire();
+  heapservice();
+  if (!loadjob.busy) return false;
+  if (loadjob.waiting) {
+    if (heapcompacting()) return false;
+    loadjob.busy=false;
+    return loadbegin() && !loadjob.busy;  // true if it was all shared and swapped in right away
+  }
+  uint32_t start=micros();
+  bool more=true;
+  do {
+    struct loaditem *item=&loadjob.item[loadjob.current];
+    bool done;
+    if (loadjob.fromcache) {
+      uint32_t before=cachedone;
+      done=cacheread();
+      if (item->slot < NTRACKS) onsetfeed(item->buf+before,cachedone-before);
+    }
+    else {
+      uint32_t before=ws.loaded;
+      done=wavread();
+      cachewrite(ws.buf+before,ws.loaded-before);
+      if (item->slot < NTRACKS) onsetfeed(ws.buf+before,ws.loaded-before);
+    }
+    if (done) {
+      if (loadjob.fromcache) item->size=cachedone;
+      else {
+        item->size=ws.loaded;
+        cachefinish();
+      }
+      if (item->slot < NTRACKS) keepslices(item);
+#ifdef DEBUG
+      loadjob.loaded+=item->size*2;
+#endif
+#ifdef DEBUG
+      Serial.printf("loaded %s %d words at addr %x%s\n",item->path,item->size,item->buf,loadjob.fromcache ? " from cache" : "");
+#endif
+      more=loadnext();
+    }
+  } while (more && ((micros()-start) < LOAD_SLICE_MICROS));
+  if (more) {
+    drawloadbar(loadprogress());
+    return false;
+  }
+  loadjob.busy=false;
+  drawloadbar(0);
+#ifdef DEBUG
+  int16_t n=swapsamples();
+  uint32_t ms=(micros()-loadjob.start)/1000;
+  Serial.printf("loaded %d samples %d bytes in %d ms\n",n,loadjob.bytes,ms);
+  if (loadjob.loaded != 0) Serial.printf("slice detection %d us - %d us per MB\n",onsetmicros,(uint32_t)((uint64_t)onsetmicros*1048576/loadjob.loaded));
+#else
+  swapsamples();
+#endif
+  return true;
+}
@@ -26,354 +26,442 @@
 // modded to generate header files from 22khz 16bit PCM wav files 
 // header files are formatted specifically for my Motivation Radio drum machine/sample player sketch
 // R Heslip Oct 2024 - modded into a function to convert/load wav files into memory
+// rewritten to parse the header once and stream the audio in big sector aligned blocks
+// the SD card is much faster reading whole sectors than one byte at a time through FsFile::read()
+// files at any sample rate are converted to SAMPLERATE by a band limited polyphase resampler as they stream in
 
-uint8_t read_uint8();
-int16_t read_int16();
-uint32_t read_uint32();
-//File32 in; 
 FsFile in; 
-bool EOF_error;  // added for debugging data read errors
+
+#define SD_SECTOR 512   // SD card sector size
+#define WAV_BLOCK 8192  // bytes per audio data read - a multiple of the sector size
+#define WAV_MAX_FRAME 6 // biggest frame is 24 bit stereo
+
+// little endian values from a byte buffer
+#define GET16(p) ((uint16_t)((p)[0] | ((p)[1] << 8)))
+#define GET32(p) ((uint32_t)((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((uint32_t)(p)[3] << 24)))
+
+#define RIFF_ID 0x46464952  // "RIFF"
+#define WAVE_ID 0x45564157  // "WAVE"
+#define FMT_ID 0x20746D66   // "fmt "
+#define DATA_ID 0x61746164  // "data"
+
+// the .wav file that is being loaded
+struct wavinfo {
+  uint16_t channels;
+  uint16_t bits;
+  uint16_t framesize;   // bytes per frame ie one sample for each channel
+  uint32_t rate;
+  uint32_t datasize;    // bytes of audio data
+  uint32_t dataoffset;  // file position of the audio data
+  uint32_t length;      // samples after conversion
+  uint32_t filesize;    // size and FAT modify date/time of the file - used to check the converted copy in the cache is up to date
+  uint16_t date;
+  uint16_t time;
+} wav;
+
+uint8_t wavblock[WAV_MAX_FRAME+WAV_BLOCK]; // the front has room for a partial frame left over from the last block
+
+// resampler
+// files at 4x SAMPLERATE or more are first decimated by 2 with a halfband filter until they are under 4x
+// a polyphase filter then converts what is left to SAMPLERATE
+// each output sample is a windowed sinc FIR of the input samples around its position
+// the filter is worked out for RESAMPLE_PHASES positions between two input samples and the output is interpolated between the two nearest
+// the cutoff is set so nothing above half the lower of the two rates gets through - downsampling doesn't alias and upsampling doesn't image
+// when downsampling the filter is stretched by the rate ratio so it always spans RESAMPLE_TAPS output samples
+// the halfband stages keep that ratio under 4 so the filter stays short at 96khz and 192khz
+// positions are 32.32 fixed point so the length and pitch are exact for any pair of rates
+#define RESAMPLE_TAPS 32      // filter length at a ratio of 1 or less - even
+#define RESAMPLE_MAX_TAPS (4*RESAMPLE_TAPS) // longest filter - the halfband stages keep the ratio under 4
+#define RESAMPLE_PHASES 32    // filter phases between input samples - power of 2
+#define RESAMPLE_PHASE_SHIFT 27 // 32 bit position fraction to phase
+#define RESAMPLE_WEIGHT_SHIFT 12 // rest of the fraction to a 15 bit weight between phases
+#define RESAMPLE_BITS 14      // coefficient fraction bits - sum of |coefficients| stays well under 2 so an int32 can't overflow
+#define RESAMPLE_CUTOFF 0.41  // fraction of the lower rate - the transition band ends at half of it
+#define HALFBAND_TAPS 27      // decimate by 2 filter length - 3 more than a multiple of 4 so the taps at both ends aren't 0
+#define HALFBAND_STAGES 3     // enough to get 192khz under 4x SAMPLERATE at 11khz
+#define HALFBAND_HISTORY (HALFBAND_TAPS-1)
+#define RESAMPLE_BUFFER (2*RESAMPLE_MAX_TAPS+HALFBAND_STAGES*HALFBAND_HISTORY+WAV_BLOCK/2+1) // history + room for the halfband history + a block of 16 bit mono frames + a partial frame
+
+struct resampler {
+  bool on;              // false if the file is already at SAMPLERATE
+  uint16_t stages;      // halfband decimate by 2 stages
+  uint16_t taps;        // polyphase filter length for this rate
+  uint32_t stepint;     // input samples per output sample - 32.32 fixed point
+  uint32_t stepfrac;
+  uint32_t frac;        // fraction of the position of the next output sample
+  uint32_t pos;         // whole part as an index into resamplebuf - can run past count when downsampling
+  uint32_t count;       // samples in resamplebuf
+  uint32_t out;         // samples written
+} rs;
+
+struct halfband {
+  uint32_t next;        // index of the input sample at the centre of the next output - from the start of the next block
+  int16_t history[HALFBAND_HISTORY]; // last input samples of the block before
+} hb[HALFBAND_STAGES];
+
+int16_t resamplefilter[(RESAMPLE_PHASES+1)*RESAMPLE_MAX_TAPS]; // taps for each phase - the extra one is a whole sample later for interpolating
+int16_t halfbandfilter[(HALFBAND_TAPS+1)/4]; // taps 1, 3, 5.. from the centre - the centre tap is 1/2 and the even ones are 0
+int16_t resamplebuf[RESAMPLE_BUFFER]; // input samples - starts with the filter history from the last block
+
+// blackman window for tap distance t from the centre of a filter of length n
+float blackman(float t, int16_t n) {
+  return 0.42+0.5*cosf(2*PI*t/n)+0.08*cosf(4*PI*t/n);
+}
+
+// set up the resampler for a file of frames at wav.rate
+// works out the filters for the rate pair and returns the number of samples after conversion
+uint32_t resamplestart(uint32_t frames) {
+  rs.on=(wav.rate != SAMPLERATE);
+  rs.out=0;
+  if (!rs.on) return frames;
+  rs.stages=0;
+  while ((rs.stages < HALFBAND_STAGES) && ((wav.rate >> rs.stages) >= 4*SAMPLERATE)) ++rs.stages;
+  uint32_t rate=wav.rate >> rs.stages;  // only for working out the filter - the step is exact
+  uint64_t step=((uint64_t)wav.rate << 32)/((uint64_t)SAMPLERATE << rs.stages);
+  rs.stepint=step >> 32;
+  rs.stepfrac=(uint32_t)step;
+  rs.frac=0;
+  rs.taps=RESAMPLE_TAPS;
+  if (rate > SAMPLERATE) rs.taps=min((uint32_t)RESAMPLE_MAX_TAPS,(RESAMPLE_TAPS*rate/SAMPLERATE+1) & ~1);
+  rs.count=rs.taps/2-1;  // silence before the first sample
+  rs.pos=rs.count;
+  for (uint32_t i=0; i < rs.count; ++i) resamplebuf[i]=0;
+
+  for (int s=0; s < rs.stages; ++s) {
+    hb[s].next=HALFBAND_HISTORY/2;  // first output is centred on the first sample - the history is silence
+    for (int i=0; i < HALFBAND_HISTORY; ++i) hb[s].history[i]=0;
+  }
+  if (rs.stages > 0) {  // cutoff at 1/4 of the rate - the transition band is wide but it only has to keep out what would alias below SAMPLERATE/2
+    float h[(HALFBAND_TAPS+1)/4], sum=0;
+    for (int k=0; k < (HALFBAND_TAPS+1)/4; ++k) {
+      float t=2*k+1;
+      h[k]=sinf(PI*t/2)/(PI*t)*blackman(t,HALFBAND_TAPS+1);
+      sum+=2*h[k];
+    }
+    for (int k=0; k < (HALFBAND_TAPS+1)/4; ++k) halfbandfilter[k]=lrintf(h[k]*0.5/sum*32768); // the odd taps add up to 1/2 like the centre so the gain is 1
+  }
+
+  float fc=RESAMPLE_CUTOFF*min(rate,(uint32_t)SAMPLERATE)/rate; // cutoff in cycles per input sample
+  for (int p=0; p <= RESAMPLE_PHASES; ++p) {
+    float h[RESAMPLE_MAX_TAPS];
+    float sum=0;
+    int16_t *f=resamplefilter+p*rs.taps;
+    for (int k=0; k < rs.taps; ++k) {
+      float t=k-(rs.taps/2-1)-(float)p/RESAMPLE_PHASES; // distance of tap k from the output position
+      float x=2*PI*fc*t;
+      h[k]=(t == 0) ? 1 : sinf(x)/x;
+      h[k]*=blackman(t,rs.taps);
+      sum+=h[k];
+    }
+    int32_t total=0;
+    for (int k=0; k < rs.taps; ++k) {  // every phase has a gain of 1
+      f[k]=lrintf(h[k]*(1 << RESAMPLE_BITS)/sum);
+      total+=f[k];
+    }
+    f[rs.taps/2-1]+=(1 << RESAMPLE_BITS)-total; // rounding error goes on the centre tap
+  }
+  return ((uint64_t)frames*SAMPLERATE+wav.rate-1)/wav.rate;
+}
+
+// decimate the n samples at x by 2 with halfband stage s
+// the HALFBAND_HISTORY samples before x are overwritten with the history from the last block and the output goes there
+// each output only reads samples after the ones already written so it can be done in place
+// returns the number of samples written - they start at x-HALFBAND_HISTORY
+uint32_t decimate(int16_t s, int16_t *x, uint32_t n) {
+  struct halfband *st=&hb[s];
+  int16_t *w=x-HALFBAND_HISTORY;
+  uint32_t out=0, i;
+  memcpy(w,st->history,sizeof(st->history));
+  for (i=st->next; i < n; i+=2) {  // w[i] is the oldest sample of the output centred on x[i-HALFBAND_HISTORY/2]
+    const int16_t *c=w+i+HALFBAND_HISTORY/2;
+    int32_t acc=(int32_t)c[0] << 14;  // centre tap is 1/2 in Q15
+    for (int k=0; k < (HALFBAND_TAPS+1)/4; ++k) acc+=halfbandfilter[k]*(c[-(2*k+1)]+c[2*k+1]);
+    acc=(acc+(1 << 14)) >> 15;
+    w[out++]=constrain(acc,-32768,32767);
+  }
+  st->next=i-n;
+  memcpy(st->history,w+n,sizeof(st->history));  // the last input samples - the outputs haven't got this far
+  return out;
+}
+
+// add n samples that have been put at resamplebuf+rs.count+HALFBAND_STAGES*HALFBAND_HISTORY to the resampler
+// they go through the halfband stages first if there are any
+void resampleadd(uint32_t n) {
+  int16_t *x=resamplebuf+rs.count+HALFBAND_STAGES*HALFBAND_HISTORY;
+  for (int s=0; s < rs.stages; ++s) {
+    n=decimate(s,x,n);
+    x-=HALFBAND_HISTORY;
+  }
+  memmove(resamplebuf+rs.count,x,n*sizeof(int16_t));
+  rs.count+=n;
+}
+
+// filter the samples added to resamplebuf into dst
+// stops when the filter would need samples that haven't been read yet or when the file is done
+// the samples still needed are moved to the front of resamplebuf for the next block
+// returns the number of samples written
+uint32_t resample(int16_t *dst) {
+  int16_t *start=dst;
+  while ((rs.pos+rs.taps/2 < rs.count) && (rs.out < wav.length)) {
+    const int16_t *h0=resamplefilter+(rs.frac >> RESAMPLE_PHASE_SHIFT)*rs.taps;
+    const int16_t *h1=h0+rs.taps;  // next phase
+    const int16_t *x=resamplebuf+rs.pos-(rs.taps/2-1);
+    int32_t acc0=0, acc1=0;
+    for (int k=0; k < rs.taps; ++k) {
+      acc0+=h0[k]*x[k];
+      acc1+=h1[k]*x[k];
+    }
+    int32_t w=(rs.frac >> RESAMPLE_WEIGHT_SHIFT) & 0x7FFF;
+    int32_t acc=acc0+(int32_t)(((int64_t)(acc1-acc0)*w) >> 15);
+    acc=(acc+(1 << (RESAMPLE_BITS-1))) >> RESAMPLE_BITS;
+    *dst++=constrain(acc,-32768,32767);
+    ++rs.out;
+    uint32_t f=rs.frac+rs.stepfrac;
+    rs.pos+=rs.stepint+(f < rs.frac); // carry from the fraction
+    rs.frac=f;
+  }
+  uint32_t keep=rs.pos-(rs.taps/2-1);  // first sample still needed
+  if (keep > rs.count) keep=rs.count;
+  memmove(resamplebuf,resamplebuf+keep,(rs.count-keep)*sizeof(int16_t));
+  rs.count-=keep;
+  rs.pos-=keep;
+  return dst-start;
+}
 
 // WAV file format:
 // http://www-mmsp.ece.mcgill.ca/Documents/AudioFormats/WAVE/WAVE.html
 //
-// pass a null buf pointer to skip loading data 
-// returns data size in words or 0 if no data/error loading file
+// open a .wav file and read its header
+// chunks we don't use are skipped with a seek
+// leaves the file at the start of the audio data for wavload()
+// returns the number of 16 bit samples that wavload() will load or 0 if the file can't be used - the file is closed on error
 
-int32_t loadwav(char * path, uint8_t * buf)
+int32_t wavopen(char * path)
 {
+  uint8_t header[16];
+  uint32_t id, size;
+  bool gotformat=false;
 
-	uint32_t header[4];
-	int16_t format, channels, bits,datasize,bytespersample;
-	uint32_t rate;
-	uint32_t i, length, padlength=0, arraylen;
-	uint32_t chunkSize;
-	int32_t audio=0;
-	uint32_t skip=1; // 1 is no downsampling
-  unsigned int bcount, wcount;
-  unsigned int total_length=0;
-  int pcm_mode=1;
-
-  EOF_error=false;
-
-	in = sd.open(path); // open the file
-
-	// read the WAV file's header
-	for (i=0; i < 4; i++) {
-		header[i] = read_uint32();
-	}
-  if (header[0] != 0x46464952) return 0; // check for "WAVE" header
-	while (header[3] != 0x20746D66) {
-		// skip past unknown sections until "fmt "
-		chunkSize = read_uint32();
-		for (i=0; i < chunkSize; i++) {
-			read_uint8();
-		}
-		header[3] = read_uint32();
-	}
-	chunkSize = read_uint32();
-
-	// read the audio format parameters
-	format = read_int16();
-	channels = read_int16();
-	rate = read_uint32();
-	read_uint32(); // ignore byterate
-	read_int16();  // ignore blockalign
-	bits = read_int16();
-  datasize=bits/8;
-#ifdef DEBUG
-	Serial.printf("format: %d, channels: %d, rate: %d, bits %d datasize %d\n", format, channels, rate, bits,datasize);
-#endif
-	if (format != 1) {
-#ifdef DEBUG    
-	  Serial.printf("file %s is compressed, only uncompressed supported\n", path);
-    return 0;
-#endif
-  }
-//	if (rate != 22050)
-//		die("sample rate %d in %s is unsupported\n"
-//		  "sample rate must be 22050", rate, filename);
-	if (channels != 1 && channels != 2) {
-#ifdef DEBUG
-    Serial.printf("file %s has %d channels, but only 1 & 2 are supported\n", path, channels);
-#endif
-    return 0;
-  } 
-	
-	if (!((bits == 16) | (bits ==24))) {
+  in = sd.open(path); // open the file
+  if (!in) return 0;
+
+  if ((in.read(header,12) != 12) || (GET32(header) != RIFF_ID) || (GET32(header+8) != WAVE_ID)) { // check for "RIFF" "WAVE" header
 #ifdef DEBUG
-    Serial.printf("file %s has %d bit format, but only 16 or 24 is supported\n", path, bits);
+    Serial.printf("file %s is not a .wav file\n", path);
 #endif
+    in.close();
     return 0;
   }
-	if (rate == 44100) {
-#ifdef DEBUG
-		Serial.printf("Resampling 44khz file to 22khz\n");
-		skip=2; // write every 2nd sample
-#endif
-	}
 
-	// skip past any extra data on the WAVE header (hopefully it doesn't matter?)
-	for (chunkSize -= 16; chunkSize > 0; chunkSize--) {
-		read_uint8();
+  while (1) { // find the format and data chunks
+    if (in.read(header,8) != 8) {
 #ifdef DEBUG
-	  if (EOF_error) { 
-      Serial.printf("end of data reading extra %d header bytes \n",chunkSize);
+      Serial.printf("end of file %s before audio data\n", path);
+#endif
+      in.close();
       return 0;
     }
-#endif 
-	}
-
-	// read the data header, skip non-audio data
-	while (1) {
-		header[0] = read_uint32();
-#ifdef DEBUG
-	  if (EOF_error) { 
-      Serial.printf("end of data reading header[0]\n");
-      return 0; 
-    }
-#endif 
-		length = read_uint32();
-#ifdef DEBUG
-	  if (EOF_error) { 
-        Serial.printf("end of data reading data length\n");
-        return 0; // size of the data read
-    }
-#endif 
-
-    if ((length % 2) && (header[0] != 0x61746164)) { // fix for bad non-audio chunks in some files
-      ++length;
-#ifdef DEBUG
-      Serial.printf("Non-audio chunk %4x length %d was rounded up\n",header[0],length);
-#endif 
-    }
-
-
+    id=GET32(header);
+    size=GET32(header+4);
 #ifdef DEBUG
-    Serial.printf("Chunk %4xX length %4xX %dD bytes\n",header[0],length,length);
-	  if (EOF_error) { 
-      Serial.printf("end of data reading data length\n");
-      return 0; // size of the data read
+    Serial.printf("Chunk %4xX length %4xX %dD bytes\n",id,size,size);
+#endif
+    if (id == DATA_ID) break; // beginning of actual audio data
+    if (id == FMT_ID) {
+      if ((size < 16) || (in.read(header,16) != 16)) {
+        in.close();
+        return 0;
+      }
+      if (GET16(header) != 1) {
+#ifdef DEBUG    
+        Serial.printf("file %s is compressed, only uncompressed supported\n", path);
+#endif
+        in.close();
+        return 0;
+      }
+      wav.channels=GET16(header+2);
+      wav.rate=GET32(header+4);
+      wav.bits=GET16(header+14); // ignore byterate and blockalign
+      gotformat=true;
+      size-=16;  // skip any extra format data
     }
-#endif 
-		if (header[0] == 0x61746164) break; // beginning of actual audio data
-		// skip over non-audio data
-		for (i=0; i < length; i++) {
-			read_uint8();
-#ifdef DEBUG
-	  if (EOF_error) { 
-      Serial.printf("end of data reading %d non-audio section\n",length);
+    if (size & 1) ++size; // chunks are padded to an even length
+    if (!in.seekCur(size)) {
+      in.close();
       return 0;
     }
-#endif 
-		}
-	}
-
-/*
-	// the length must be a multiple of the data size
-	if (channels == 2) {
-		if (length % 4) {
+  }
+  if (!gotformat) {
+    in.close();
+    return 0;
+  }
 #ifdef DEBUG
-      Serial.printf("file %s data length is not a multiple of 4\n", path);
+  Serial.printf("channels: %d, rate: %d, bits %d\n", wav.channels, wav.rate, wav.bits);
 #endif
-      return 0;
-    } 
-		length = length / 4;
-	}
-	if (channels == 1) {
-		length = length / 2;
-		if (length % 1){
+  if ((wav.channels != 1) && (wav.channels != 2)) {
 #ifdef DEBUG
-      Serial.printf("file %s data length is not a multiple of 2\n", path);
+    Serial.printf("file %s has %d channels, but only 1 & 2 are supported\n", path, wav.channels);
 #endif
-      return 0;
-    }  
-	}
-	*/
-  bytespersample=channels * datasize;
-	if (length % bytespersample) { // check that data chunk is is correct size
+    in.close();
+    return 0;
+  } 
+  if ((wav.bits != 16) && (wav.bits != 24)) {
 #ifdef DEBUG
-      Serial.printf("file %s data length %d is not a multiple of %d\n", path,length,bytespersample);
+    Serial.printf("file %s has %d bit format, but only 16 or 24 is supported\n", path, wav.bits);
 #endif
+    in.close();
     return 0;
-  }   
-
-	length = length / bytespersample;
-	if (length % 1){
+  }
+  wav.framesize=wav.channels*wav.bits/8;
+  wav.datasize=size-(size % wav.framesize); // ignore a partial frame at the end
+  wav.dataoffset=in.curPosition();
+  wav.filesize=in.fileSize();
+  wav.date=wav.time=0;
+  in.getModifyDateTime(&wav.date,&wav.time);
+  if ((wav.rate < 1000) || (wav.rate > 192000)) {
 #ifdef DEBUG
-    Serial.printf("file %s data length is not a multiple of 2\n", path);
+    Serial.printf("file %s sample rate %d is not supported\n", path, wav.rate);
 #endif
+    in.close();
     return 0;
-  } 
-
-	if (length > 0xFFFFFF) {
-  #ifdef DEBUG
-    Serial.printf("file %s data length is too long\n", path);
-  #endif
-    return 0; 
   }
-	bcount = 0;
-	
-	if (pcm_mode) {
-		//arraylen = ((length + padlength) * 2 + 3) / 4 + 1;
-		arraylen = length/skip; // RH skip=2 for downsampling from 44 to 22khz
-		format |= 0x80;
-	} else {
-		arraylen = (length + padlength + 3) / 4 + 1;
-	}
-	total_length += arraylen;
-
-	// output a minimal header, just the length, #bits and sample rate
-	//fprintf(outh, "extern const unsigned int AudioSample%s[%d];\n", samplename, arraylen);
+  wav.length=resamplestart(wav.datasize/wav.framesize);
+  if (wav.length > 0xFFFFFF) {
 #ifdef DEBUG
-	Serial.printf("// Converted from %s, using %d Hz, %s encoding , %d bits, %d samples\n", path, rate,
-	  (pcm_mode ? "16 bit PCM" : "u-law"),bits, arraylen);
+    Serial.printf("file %s data length is too long\n", path);
 #endif
-	//Serial.printf("#define %s_SIZE %d\n\n", samplename, arraylen);	  
-	//fprintf(out, "const uint16_t %s[%d] = {\n", samplename, arraylen);
-	//Serial.printf("const int16_t %s[] = {\n", samplename);
-	//fprintf(out, "0x%08X,", length | (format << 24));
-	wcount = 0;
-
-  if (buf !=0) { // if we pass a null pointer don't load data - so we can use the same function to get the data size
-	// finally, read the audio data
-    while (length > 0) {
-      if (channels == 1) {
-        if (bits==24) read_uint8(); // toss low byte
-        audio = read_int16();
-#ifdef DEBUG
-	      if (EOF_error) { 
-          Serial.printf("end of data - expecting %d more samples\n",length);
-          return (arraylen-length); // size of the data read
-        }
-#endif       
-      } else {
-        if (bits==24) read_uint8(); // toss low byte
-        audio = read_int16();
-        if (bits==24) read_uint8(); // toss low byte
-        audio += read_int16();
-        audio /= 2;
-#ifdef DEBUG
-	      if (EOF_error) { 
-          Serial.printf("end of data - expecting %d more samples\n",length);
-          return (arraylen-length); // size of the data read
-        }
-#endif 
-      }
-      if (pcm_mode) {
-        if ((length % skip)==0) {// downsampling if skip >1
-          *buf=audio;
-          ++buf;
-          *buf=audio>>8;
-          ++buf;
-        //	print_byte(out, audio);
-        //	print_byte(out, audio >> 8);
-        }
-      } else {
-        *buf=audio;
-        ++buf;
-      //	print_byte(out, ulaw_encode(audio));
-      }
-      length--;
-    }
-    while (padlength > 0) {
-      *buf=0;
-      ++buf;
-      // print_byte(out, 0);
-      padlength--;
-    }
-    while (bcount > 0) {
-      *buf=0;
-      ++buf;
-      // print_byte(out, 0);
-    }
+    in.close();
+    return 0; 
   }
-  return arraylen;
+  return wav.length;
 }
 
-uint8_t read_uint8()
+// open a .wav file again after wavopen() has read its header - info is the wav it filled in
+// the header isn't parsed again - the file is checked against the size and modify time in info and left at the start of the audio data
+// returns the same as wavopen() or 0 if the file has changed or can't be read - the file is closed on error
+int32_t wavreopen(char * path, struct wavinfo *info)
 {
-	int c1;
-
-	c1 = in.read();
-	if (c1 == EOF) {
+  uint16_t date=0, time=0;
+  in = sd.open(path);
+  if (!in) return 0;
+  in.getModifyDateTime(&date,&time);
+  if ((in.fileSize() != info->filesize) || (date != info->date) || (time != info->time) || !in.seekSet(info->dataoffset)) {
 #ifdef DEBUG
-	  Serial.printf("error, end of data while reading file\n");
+    Serial.printf("file %s has changed\n", path);
 #endif
-    EOF_error=true;
-    return 0; 
+    in.close();
+    return 0;
   }
-	c1 &= 255;
-	return c1;
+  wav=*info;
+  wav.length=resamplestart(wav.datasize/wav.framesize);
+  return wav.length;
 }
 
-int16_t read_int16()
-{
-	int c1, c2;
+// convert a block of frames to 16 bit mono samples
+// returns the number of samples written
+uint32_t wavconvert(uint8_t *src, uint32_t frames, int16_t *dst) {
+  uint8_t *p=src+wav.bits/8-2;  // top 16 bits of a sample - the low byte of 24 bit samples is dropped
+
+  if (wav.channels == 1) {
+    for (uint32_t i=0; i < frames; ++i, p+=wav.framesize) *dst++=(int16_t)GET16(p);
+  }
+  else {
+    for (uint32_t i=0; i < frames; ++i, p+=wav.framesize) *dst++=((int32_t)(int16_t)GET16(p)+(int32_t)(int16_t)GET16(p+wav.framesize/2))/2;
+  }
+  return frames;
+}
 
-	c1 = in.read();
-	if (c1 == EOF) {
+// the load in progress
+// the audio data is read a block at a time by wavread() so a big file can be loaded a bit at a time while everything else keeps running
+struct wavstream {
+  int16_t *buf;         // where the samples go
+  uint32_t remaining;   // bytes of audio data still to read
+  uint32_t carry;       // bytes of a partial frame left from the last block
+  uint32_t blocksize;   // bytes to read next
+  uint32_t loaded;      // samples written to buf
 #ifdef DEBUG
-	  Serial.printf("error, end of data while reading file\n");
+  uint32_t start;
+  uint32_t resampleus;  // time spent resampling - should be small next to the SD reads
 #endif
-    EOF_error=true;
-    return 0; 
-  }
-	c2 = in.read();
-	if (c2 == EOF) {
+} ws;
+
+// start loading the audio data of the file opened by wavopen() into buf
+// the first read ends on a sector boundary so the rest are whole sectors straight from the card
+void wavbegin(int16_t * buf) {
+  ws.buf=buf;
+  ws.remaining=wav.datasize;
+  ws.carry=0;
+  ws.loaded=0;
+  ws.blocksize=SD_SECTOR-(wav.dataoffset % SD_SECTOR); // read up to the next sector boundary first
 #ifdef DEBUG
-	  Serial.printf("error, end of data while reading file\n");
+  ws.start=micros();
+  ws.resampleus=0;
 #endif
-    EOF_error=true;
-    return 0; 
-  }
-	c1 &= 255;
-	c2 &= 255;
-	return (c2 << 8) | c1;
 }
 
-uint32_t read_uint32()
-{
-	int c1, c2, c3, c4;
-
-	c1 = in.read();
-	if (c1 == EOF) {
+// read and convert the next block of the load started by wavbegin()
+// returns true when the load is finished and the file is closed - ws.loaded is the number of samples loaded
+bool wavread(void) {
+  uint32_t n=ws.blocksize;
+  if (n > ws.remaining) n=ws.remaining;
+  if ((n == 0) || (in.read(wavblock+ws.carry,n) != (int)n)) {
 #ifdef DEBUG
-	  Serial.printf("error, end of data while reading file\n");
+    if (n != 0) Serial.printf("end of data - expecting %d more bytes\n",ws.remaining);
 #endif
-    EOF_error=true;
-    return 0; 
-  }
-	c2 = in.read();
-	if (c2 == EOF) {
+    in.close();
+    if (rs.on && (n == 0)) { // silence after the last sample for the filter tails
+      uint32_t tail=(HALFBAND_HISTORY/2 << rs.stages)+(rs.taps/2 << rs.stages);
+      while (tail > 0) {
+        uint32_t z=min(tail,(uint32_t)WAV_BLOCK/2);
+        for (uint32_t i=0; i < z; ++i) resamplebuf[rs.count+HALFBAND_STAGES*HALFBAND_HISTORY+i]=0;
+        resampleadd(z);
+        ws.loaded+=resample(ws.buf+ws.loaded);
+        tail-=z;
+      }
+    }
 #ifdef DEBUG
-	  Serial.printf("error, end of data while reading file\n");
+    uint32_t us=micros()-ws.start;
+    Serial.printf("loaded %d bytes in %d us %d.%02d MB/s\n",wav.datasize,us,wav.datasize/(us ? us : 1),(wav.datasize%(us ? us : 1))*100/(us ? us : 1));
+    if (rs.on) Serial.printf("resampled %d Hz to %d Hz - %d samples in %d us\n",wav.rate,SAMPLERATE,ws.loaded,ws.resampleus);
 #endif
-    EOF_error=true;
-    return 0; 
+    return true;
   }
-	c3 = in.read();
-	if (c3 == EOF) {
+  ws.remaining-=n;
+  n+=ws.carry;
+  uint32_t frames=n/wav.framesize;
+  if (rs.on) {
 #ifdef DEBUG
-	  Serial.printf("error, end of data while reading file\n");
+    uint32_t t=micros();
 #endif
-    EOF_error=true;
-    return 0; 
-  }
-	c4 = in.read();
-	if (c4 == EOF) {
+    resampleadd(wavconvert(wavblock,frames,resamplebuf+rs.count+HALFBAND_STAGES*HALFBAND_HISTORY));
+    ws.loaded+=resample(ws.buf+ws.loaded);
 #ifdef DEBUG
-	  Serial.printf("error, end of data while reading file\n");
+    ws.resampleus+=micros()-t;
 #endif
-    EOF_error=true;
-    return 0; 
   }
-	c1 &= 255;
-	c2 &= 255;
-	c3 &= 255;
-	c4 &= 255;
-	return (c4 << 24) | (c3 << 16) | (c2 << 8) | c1;
+  else ws.loaded+=wavconvert(wavblock,frames,ws.buf+ws.loaded);
+  ws.carry=n-frames*wav.framesize;
+  memmove(wavblock,wavblock+frames*wav.framesize,ws.carry);
+  ws.blocksize=WAV_BLOCK;
+  return false;
 }
 
+// how far the load has got in %
+int16_t wavprogress(void) {
+  if (wav.datasize == 0) return 100;
+  return (uint64_t)(wav.datasize-ws.remaining)*100/wav.datasize;
+}
 
+// load all the audio data of the file opened by wavopen() into buf and close the file
+// returns the number of samples loaded
+int32_t wavload(int16_t * buf)
+{
+  wavbegin(buf);
+  while (!wavread());
+  return ws.loaded;
+}
 
+// close the file opened by wavopen() without loading it
+void wavclose(void) {
+  in.close();
+}
@@ -158,282 +158,400 @@ void testfunc(void) {
 const char * scalenames[] = {"Chro","Maj", "Min","Hmin","MPen","mPen","Dor","Phry","Lyd","Mixo"};
 const char * shiftdirection[] = {"<"," ",">"};
 const char * onoff[] = {" Off","  On"};
+const char * patmodenames[] = {"Clip"," Gen"};
+const char * launchnames[] = {"Step","Beat"," Bar"};
+const char * divisionnames[] = {"  1/4","  1/8"," 1/8T"," 1/16","1/16T"," 1/32","1/32T"};
+const char * groovenames[] = {"  Off","Sw 54","Sw 58","Sw 62","Sw 66","Sw 71","Accnt"," User"};
+const char * getgroovenames[] = {"    "," Get"};
+const char * defragnames[] = {"    ","  Go"};
+const char * timesignames[] = {" 4/4"," 3/4"," 5/4"," 7/4"," 2/4"," 6/8"," 7/8"," 9/8","12/8"};
 
 struct submenu sample0params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",0,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[0],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[0],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[0],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[0],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[0].tune,0, 
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[0],setshuffle,
-//  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[0],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[0].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[0],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[0],setpattern,   
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[0],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[0],setpattern,
   "Pat Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[0],pitchrandomizer,  
   "Pat Accents",0,16,1,TYPE_INTEGER,0,&patvelocity[0],velocityrandomizer,  
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[0],0,               
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[0],setpatmode,
 };
 
 struct submenu sample1params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",1,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[1],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[1],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[1],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[1],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[1].tune,0, 
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[1],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[1],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[1].slices,0, 
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[1],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[1],setpattern, 
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[1],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[1],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[1],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[1],velocityrandomizer,  
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[1],0,                
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[1],setpatmode,
 };
 
 struct submenu sample2params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",2,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[2],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[2],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[2],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[2],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[2].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[2],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[2],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[2].slices,0, 
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[2],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[2],setpattern,          
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[2],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[2],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[2],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[2],velocityrandomizer, 
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[2],0,       
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[2],setpatmode,
 };
 
 struct submenu sample3params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",3,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[3],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[3],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[3],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[3],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[3].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[3],setshuffle, 
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[3],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip, 
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[3].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[3],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[3],setpattern,        
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[3],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[3],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[3],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[3],velocityrandomizer, 
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[3],0,       
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[3],setpatmode,
 };
 
 struct submenu sample4params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",4,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[4],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[4],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[4],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[4],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[4].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[4],setshuffle, 
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[4],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip, 
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[4].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[4],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[4],setpattern,      
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[4],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[4],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[4],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[4],velocityrandomizer,
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[4],0,       
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[4],setpatmode,
 };
 
 struct submenu sample5params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",5,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[5],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[5],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[5],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[5],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[5].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[5],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[5],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[5].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[5],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[5],setpattern,     
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[5],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[5],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[5],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[5],velocityrandomizer,
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[5],0,      
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[5],setpatmode,
 };
 
 struct submenu sample6params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",6,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[6],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[6],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[6],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[6],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[6].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[6],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[6],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[6].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[6],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[6],setpattern,     
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[6],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[6],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[6],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[6],velocityrandomizer,
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[6],0,       
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[6],setpatmode,
 };
 
 struct submenu sample7params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",7,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[7],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[7],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[7],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[7],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[7].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[7],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[7],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[7].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[7],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[7],setpattern,      
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[7],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[7],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[7],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[7],velocityrandomizer,
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[7],0,       
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[7],setpatmode,
 };
 
 struct submenu sample8params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",8,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[8],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[8],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[8],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[8],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[8].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[8],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[8],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[8].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[8],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[8],setpattern,              
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[8],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[8],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[8],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[8],velocityrandomizer,
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[8],0,       
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[8],setpatmode,
 };
 
 struct submenu sample9params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",9,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[9],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[9],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[9],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[9],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[9].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[9],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[9],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[9].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[9],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[9],setpattern,    
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[9],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[9],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[9],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[9],velocityrandomizer,
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[9],0,       
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[9],setpatmode,
 };
 
 struct submenu sample10params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",10,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[10],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[10],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[10],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[10],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[10].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[10],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[10],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[10].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[10],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[10],setpattern,        
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[10],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[10],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[10],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[10],velocityrandomizer, 
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[10],0,      
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[10],setpatmode,
 };
 
 struct submenu sample11params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",11,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[11],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[11],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[11],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[11],setlevels,   
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[11].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[11],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[11],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[11].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[11],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[11],setpattern,    
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[11],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[11],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[11],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[11],velocityrandomizer,
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[11],0,       
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[11],setpatmode,
 };
 
 struct submenu sample12params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",12,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[12],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[12],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[12],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[12],setlevels, 
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[12].tune,0,  
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[12],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[12],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[12].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[12],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[12],setpattern, 
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[12],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[12],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[12],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[12],velocityrandomizer, 
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[12],0,      
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[12],setpatmode,
 };
 
 struct submenu sample13params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",13,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[13],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[13],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[13],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[13],setlevels, 
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[13].tune,0,  
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[13],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[13],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[13].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[13],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[13],setpattern, 
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[13],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[13],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[13],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[13],velocityrandomizer,
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[13],0,       
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[13],setpatmode,
 };
 
 struct submenu sample14params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",14,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[14],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[14],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[14],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[14],setlevels, 
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[14].tune,0,
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[14],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[14],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[14].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[14],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[14],setpattern, 
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[14],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[14],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[14],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[14],velocityrandomizer, 
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[14],0,      
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[14],setpatmode,
 };
 
 struct submenu sample15params[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "",15,0,1,TYPE_FILENAME,0,&voice[0].sample,printsamplename,          // hokey - value of min is the sample number
   "Steps",1,MAX_STEPS,1,TYPE_INTEGER,0,&steps[15],setsteps,
+  "Division",0,NDIVISIONS-1,1,TYPE_TEXT,divisionnames,&division[15],setdivision,
   "Level",0,1000,10,TYPE_FLOAT,0,&tracklevel[15],setlevels,
   "Pan",-1000,1000,50,TYPE_FLOAT,0,&trackpan[15],setlevels, 
   "Tune",-12000,12000,50,TYPE_FLOAT,0,&voice[15].tune,0,  
-  "Shuffle",0,15,1,TYPE_INTEGER,0,&shuffle[15],setshuffle,
+  "Groove",0,NGROOVES-1,1,TYPE_TEXT,groovenames,&groove[15],setgroove,
+  "Get Groove",0,1,1,TYPE_TEXT,getgroovenames,&getgroove,getgrooveclip,
+  "Shift",-1,1,1,TYPE_INTEGER,0,&shift,shiftclip,
   "Slices",0,16,1,TYPE_INTEGER,0,&voice[15].slices,0,
   "Pattern",0,NUMPATTERNS-1,1,TYPE_INTEGER,0,&pattern[15],setpattern,
   "Pat Shift",0,15,1,TYPE_INTEGER,0,&patshift[15],setpattern, 
+  "Euclid Fill",0,MAX_STEPS,1,TYPE_INTEGER,0,&patfill[15],setpattern,
+  "Fill Accent",0,MAX_STEPS,1,TYPE_INTEGER,0,&pataccent[15],setpattern,
   "Note Offsets",0,15,1,TYPE_INTEGER,0,&patpitch[15],pitchrandomizer,  
   "Level Offsets",0,16,1,TYPE_INTEGER,0,&patvelocity[15],velocityrandomizer,\
   "AutoRandomize",0,1,1,TYPE_TEXT,onoff,&rerandomize[15],0,       
+  "Pat Mode",0,1,1,TYPE_TEXT,patmodenames,&patmode[15],setpatmode,
 };
 
 struct submenu scenechain[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
-  "SCENE 1",1,16,1,TYPE_INTEGER,0,&scenecount[0],0,
-  "SCENE 2",0,16,1,TYPE_INTEGER,0,&scenecount[1],0,
-  "SCENE 3",0,16,1,TYPE_INTEGER,0,&scenecount[2],0,
-  "SCENE 4",0,16,1,TYPE_INTEGER,0,&scenecount[3],0,
-  "SCENE 5",0,16,1,TYPE_INTEGER,0,&scenecount[4],0,
-  "SCENE 6",0,16,1,TYPE_INTEGER,0,&scenecount[5],0,
-  "SCENE 7",0,16,1,TYPE_INTEGER,0,&scenecount[6],0,
-  "SCENE 8",0,16,1,TYPE_INTEGER,0,&scenecount[7],0,
-  "SCENE 9",0,16,1,TYPE_INTEGER,0,&scenecount[8],0,
-  "SCENE 10",0,16,1,TYPE_INTEGER,0,&scenecount[9],0,
-  "SCENE 11",0,16,1,TYPE_INTEGER,0,&scenecount[10],0,
-  "SCENE 12",0,16,1,TYPE_INTEGER,0,&scenecount[11],0,
-  "SCENE 13",0,16,1,TYPE_INTEGER,0,&scenecount[12],0,
-  "SCENE 14",0,16,1,TYPE_INTEGER,0,&scenecount[13],0,
-  "SCENE 15",0,16,1,TYPE_INTEGER,0,&scenecount[14],0,
-  "SCENE 16",0,16,1,TYPE_INTEGER,0,&scenecount[15],0,
+  "SCENE 1",1,16,1,TYPE_INTEGER,0,&scenecount[0],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[0],compilesong,
+  "SCENE 2",0,16,1,TYPE_INTEGER,0,&scenecount[1],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[1],compilesong,
+  "SCENE 3",0,16,1,TYPE_INTEGER,0,&scenecount[2],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[2],compilesong,
+  "SCENE 4",0,16,1,TYPE_INTEGER,0,&scenecount[3],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[3],compilesong,
+  "SCENE 5",0,16,1,TYPE_INTEGER,0,&scenecount[4],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[4],compilesong,
+  "SCENE 6",0,16,1,TYPE_INTEGER,0,&scenecount[5],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[5],compilesong,
+  "SCENE 7",0,16,1,TYPE_INTEGER,0,&scenecount[6],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[6],compilesong,
+  "SCENE 8",0,16,1,TYPE_INTEGER,0,&scenecount[7],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[7],compilesong,
+  "SCENE 9",0,16,1,TYPE_INTEGER,0,&scenecount[8],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[8],compilesong,
+  "SCENE 10",0,16,1,TYPE_INTEGER,0,&scenecount[9],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[9],compilesong,
+  "SCENE 11",0,16,1,TYPE_INTEGER,0,&scenecount[10],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[10],compilesong,
+  "SCENE 12",0,16,1,TYPE_INTEGER,0,&scenecount[11],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[11],compilesong,
+  "SCENE 13",0,16,1,TYPE_INTEGER,0,&scenecount[12],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[12],compilesong,
+  "SCENE 14",0,16,1,TYPE_INTEGER,0,&scenecount[13],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[13],compilesong,
+  "SCENE 15",0,16,1,TYPE_INTEGER,0,&scenecount[14],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[14],compilesong,
+  "SCENE 16",0,16,1,TYPE_INTEGER,0,&scenecount[15],compilesong,
+  "  Bars",1,MAX_SCENE_BARS,1,TYPE_INTEGER,0,&scenebars[15],compilesong,
 };
 
 struct submenu setupparams[] = {
@@ -442,6 +560,13 @@ struct submenu setupparams[] = {
   "Volume",20,127,1,TYPE_INTEGER,0,&master_volume,0,
 //  "Steps/Bar",1,MAX_STEPS,1,TYPE_INTEGER,0,&stepsperbar,0,
   "Scale",0,9,1,TYPE_TEXT,scalenames,&current_scale,0,
+  "Time Sig",0,NTIMESIGS-1,1,TYPE_TEXT,timesignames,&timesig,settimesig,
+  "Launch Q",0,2,1,TYPE_TEXT,launchnames,&launchquantize,0,
+  "Rec Quantize",0,100,5,TYPE_INTEGER,0,&recquantize,0,
+  "Free KB",0,9999,1,TYPE_INTEGER,0,&memfree,showmemory,
+  "Used KB",0,9999,1,TYPE_INTEGER,0,&memused,showmemory,
+  "Frag %",0,100,1,TYPE_INTEGER,0,&memfrag,showmemory,
+  "Defrag",0,1,1,TYPE_TEXT,defragnames,&defrag,defragheap,
 };
 
 
@@ -863,33 +988,8 @@ void domenus(void) {
 				    strcat(temp2,"/");
             strcat(temp2,files[fileindex].name);
 
-            int32_t fsize=loadwav(temp2,0);  // null pointer just returns .wav data size in words
-            //dosequencers(); // SD is really slow so try to keep things going
-#ifdef DEBUG
-	          Serial.printf("loading %s %d words\n",temp2,fsize);
-#endif
-            if (sample[track].samplearray !=0) free(sample[track].samplearray); // deallocate psram
-            sample[track].samplesize=0; // this should stop sample playing
-            if (fsize > 0) {
-              uint8_t * p;
-              if ((p=(uint8_t *)pmalloc(((fsize*2/PMALLOC_CHUNK)+1)*PMALLOC_CHUNK)) && (((uint32_t)p+fsize*2) < (PSRAM_ADDR+PSRAM_SIZE))) { // allocate memory in PMALLOC_CHUNK units to keep fragmentation to a minimum 
-                sample[track].samplearray=(int16_t *)p;
-                sample[track].samplesize=loadwav(temp2,p); // **** no error checking yet but this should always work
-                memcpy((void *)sample[track].sname,files[fileindex].name,25); // copy first 25 chars of filename over
-                sample[track].sname[24]=0;  // make sure its null terminated
-#ifdef DEBUG
-                Serial.printf("loaded %s %d words at addr %x\n",temp2,fsize,p);
-#endif
-              }
-              else {
-                Serial.printf("pmalloc failed\n");
-                strcpy(sample[track].sname,"**Memory error**");
-                sample[track].samplearray=0;
-                sample[track].samplesize=0;
-                sample[track].sname[0]=0;
-              }
-            }
-            else strcpy(sample[track].sname,"**File load error**");
+            if (iskit(temp2)) loadkit(temp2); // loads samples on all the tracks in the kit
+            else startload(track,temp2); // loads in the background from loop() - the old sample plays till its done
           }
 			    topmenu[topmenuindex].submenuindex=0;  // restore submenu from the first item
 			    drawsubmenus();
@@ -0,0 +1,126 @@
+// onset detection for the sample slicer
+// as a sample streams into PSRAM the energy of each block of ONSET_BLOCK samples is worked out
+// when it is all in, onsets are where the energy jumps - the strongest ones become the slice points
+// each slice point is moved onto the first loud sample of the hit then back to a zero crossing so slices start cleanly
+// slices are found for every sample - slice mode uses them instead of equal slices if there are at least 2
+// all fixed point - the cost is a multiply and add per sample while loading and a few ms at the end
+
+#define ONSET_BLOCK 256       // samples per energy block - 11.6ms at 22khz
+#define ONSET_MAX_BLOCKS (1048576/ONSET_BLOCK) // longest sample is 2^20 samples - see loop1()
+#define ONSET_RISE 32         // energy rise over 2 blocks to be an onset in 1/16 doublings - 32 is x4 or 6dB
+#define ONSET_FLOOR 128       // ignore blocks more than this far below the loudest - 128 is 24dB
+#define ONSET_GAP 4           // closest onsets in blocks - 46ms
+#define ONSET_ATTACK 4        // the onset is the first sample over 1/ONSET_ATTACK of the hit's peak
+
+uint16_t onsetlevel[ONSET_MAX_BLOCKS]; // log2 energy of each block in 1/16 steps
+uint32_t onsetblocks;         // blocks done
+uint32_t onsetenergy;         // sum of squares of the block being done
+uint16_t onsetfill;           // samples in it so far
+#ifdef DEBUG
+uint32_t onsetmicros;         // time spent in the detector for the load time report
+#endif
+
+// log2 of x in 1/16 steps - the position of the top bit plus the next 4 bits of the mantissa
+uint16_t onsetlog2(uint32_t x) {
+  if (x == 0) return 0;
+  int16_t top=31-__builtin_clz(x);
+  uint32_t mantissa=(top >= 4) ? (x >> (top-4)) : (x << (4-top));
+  return (top+1)*16+(mantissa & 15);  // +1 so 0 is only used for silence
+}
+
+// start on a new sample
+void onsetbegin(void) {
+  onsetblocks=0;
+  onsetenergy=0;
+  onsetfill=0;
+}
+
+// add n samples to the block energies
+void onsetfeed(int16_t *src, uint32_t n) {
+#ifdef DEBUG
+  uint32_t start=micros();
+#endif
+  for (uint32_t i=0; i < n; ++i) {
+    int32_t x=src[i];
+    onsetenergy+=(uint32_t)(x*x) >> 8;  // 256 full scale squares fit in 32 bits
+    if (++onsetfill == ONSET_BLOCK) {
+      if (onsetblocks < ONSET_MAX_BLOCKS) onsetlevel[onsetblocks++]=onsetlog2(onsetenergy);
+      onsetenergy=0;
+      onsetfill=0;
+    }
+  }
+#ifdef DEBUG
+  onsetmicros+=micros()-start;
+#endif
+}
+
+// find where the hit that makes block b an onset starts in buf
+// the first sample over 1/ONSET_ATTACK of the peak of block b, searching from the block before, then back to a zero crossing
+uint32_t onsetstart(int16_t *buf, uint32_t b) {
+  uint32_t from=(b-1)*ONSET_BLOCK, to=(b+1)*ONSET_BLOCK;
+  int32_t peak=0;
+  for (uint32_t i=b*ONSET_BLOCK; i < to; ++i) peak=max(peak,(int32_t)abs(buf[i]));
+  uint32_t i=from;
+  while ((i < to) && (abs(buf[i])*ONSET_ATTACK < peak)) ++i;
+  for (uint32_t limit=(i > ONSET_BLOCK) ? i-ONSET_BLOCK : 0; i > limit; --i) {
+    if ((buf[i] == 0) || ((buf[i-1] < 0) != (buf[i] < 0))) break;
+  }
+  return i;
+}
+
+// pick the slice points of a sample of size samples in buf once it has all been fed through onsetfeed()
+// slice 0 always starts at the beginning, the rest start at the strongest onsets
+// returns the number of slices
+uint8_t onsetfinish(int16_t *buf, uint32_t size, uint32_t *slice) {
+#ifdef DEBUG
+  uint32_t start=micros();
+#endif
+  uint32_t where[MAX_SLICES];   // strongest onsets so far, strongest first
+  int16_t rise[MAX_SLICES];
+  uint8_t found=0;
+  uint16_t loudest=0;
+  for (uint32_t b=0; b < onsetblocks; ++b) loudest=max(loudest,onsetlevel[b]);
+  uint32_t last=0;   // block of the last onset
+  int16_t lastrise=0;
+  for (uint32_t b=ONSET_GAP; b+1 < onsetblocks; ++b) {  // anything in the first few blocks is part of slice 0
+    int16_t r=onsetlevel[b]-onsetlevel[b-2];  // over 2 blocks so a hit that starts near the end of a block still counts
+    if ((r < ONSET_RISE) || (onsetlevel[b]+ONSET_FLOOR < loudest)) continue;
+    if ((r < onsetlevel[b-1]-onsetlevel[b-3]) || (r < onsetlevel[b+1]-onsetlevel[b-1])) continue; // only the peak of the rise
+    if ((last != 0) && (b-last < ONSET_GAP)) {  // too close to the last one - keep the stronger
+      if (r <= lastrise) continue;
+      for (uint8_t j=0; j < found; ++j) {
+        if (where[j] != last) continue;
+        --found;
+        memmove(&where[j],&where[j+1],(found-j)*sizeof(uint32_t));
+        memmove(&rise[j],&rise[j+1],(found-j)*sizeof(int16_t));
+        break;
+      }
+    }
+    last=b;
+    lastrise=r;
+    uint8_t j=found;  // insert by strength, dropping the weakest when full
+    while ((j > 0) && (rise[j-1] < r)) --j;
+    if (j >= MAX_SLICES-1) continue;
+    if (found < MAX_SLICES-1) ++found;
+    memmove(&where[j+1],&where[j],(found-1-j)*sizeof(uint32_t));
+    memmove(&rise[j+1],&rise[j],(found-1-j)*sizeof(int16_t));
+    where[j]=b;
+    rise[j]=r;
+  }
+  for (uint8_t i=1; i < found; ++i) {  // back into time order - only a few so insertion sort
+    uint32_t w=where[i];
+    uint8_t j=i;
+    for (; (j > 0) && (where[j-1] > w); --j) where[j]=where[j-1];
+    where[j]=w;
+  }
+  uint8_t n=1;
+  slice[0]=0;
+  for (uint8_t i=0; i < found; ++i) {
+    uint32_t s=onsetstart(buf,where[i]);
+    if ((s > slice[n-1]) && (s < size)) slice[n++]=s;
+  }
+#ifdef DEBUG
+  onsetmicros+=micros()-start;
+#endif
+  return n;
+}
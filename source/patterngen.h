@@ -0,0 +1,156 @@
+// pattern generator variations
+// a track's random pitch and level offsets are not stored - each variation is just a 32 bit seed
+// the offset for any step is worked out when its needed by hashing the seed with the step number
+// so the same seed always gives the same variation and it only takes a few bytes to save one
+
+uint32_t pitchseed[NTRACKS];    // seed for the pattern pitch offsets
+uint32_t velocityseed[NTRACKS]; // seed for the pattern velocity offsets
+uint32_t seedstate=0x2545F491;  // xorshift state used to make new seeds
+
+// make a new variation seed
+// only from loop() and the menus - the sequencer interrupt would corrupt seedstate if it got in between, it uses nextseed()
+uint32_t newseed(void) {
+  if (seedstate == 0) seedstate=0x2545F491; // xorshift gets stuck at 0
+  seedstate ^= seedstate << 13;  // xorshift32
+  seedstate ^= seedstate >> 17;
+  seedstate ^= seedstate << 5;
+  return seedstate;
+}
+
+// counter based hash - mixes the step number into the seed
+// every step gets an independent random number without having to run a generator from the start of the clip
+uint32_t stephash(uint32_t seed, uint32_t step) {
+  uint32_t x = seed ^ (step * 0x9E3779B9);
+  x ^= x >> 16;
+  x *= 0x7feb352d;
+  x ^= x >> 15;
+  x *= 0x846ca68b;
+  x ^= x >> 16;
+  return x;
+}
+
+// next variation of a seed for the sequencer interrupt
+// a hash of the old seed so it doesn't need any state shared with loop() - the step number is past the end of any clip so it isn't one of the step hashes
+uint32_t nextseed(uint32_t seed) {
+  return stephash(seed,0x80000000);
+}
+
+// random pitch offset for step n of track t - 0 to patpitch[t]
+int8_t pitchoffset(int16_t t, int16_t n) {
+  if (patpitch[t] == 0) return 0;
+  return stephash(pitchseed[t],n) % (patpitch[t]+1);
+}
+
+// random velocity offset for step n of track t
+// offsets are in the range +- patvelocity*4 but negative values are clipped to 0 like the original random() version
+int8_t velocityoffset(int16_t t, int16_t n) {
+  int32_t range=patvelocity[t]*4;
+  if (range == 0) return 0;
+  int32_t offset=(int32_t)(stephash(velocityseed[t],n) % (2*range)) - range;
+  return constrain(offset,0,128);
+}
+
+// euclidean rhythms
+// bjorklund's algorithm builds the pattern by repeatedly pairing up a group of "hit" strings with a group of "rest" strings
+// every string in a group is the same so we only keep one of each plus a count - memory doesn't grow with the pattern length
+// the strings are bitsets with bit n = step n so patterns can be any length up to MAX_STEPS
+#define STEPBITS_WORDS ((MAX_STEPS+31)/32)
+
+struct stepbits {
+  uint32_t w[STEPBITS_WORDS];
+};
+
+struct stepbits fillbits[NTRACKS];   // euclidean fill for each track - worked out when the settings change
+struct stepbits accentbits[NTRACKS]; // accented fill steps for each track
+int16_t pataccent[NTRACKS]={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,}; // number of fill hits that are accented
+#define ACCENT_LEVEL 32 // velocity added to accented steps
+
+void clearbits(struct stepbits *b) {
+  for (int i=0; i < STEPBITS_WORDS; ++i) b->w[i]=0;
+}
+
+bool testbit(struct stepbits *b, int16_t n) {
+  return (b->w[n >> 5] & (1UL << (n & 31))) !=0;
+}
+
+void setbit(struct stepbits *b, int16_t n) {
+  b->w[n >> 5] |= 1UL << (n & 31);
+}
+
+// append len bits of src to the end of dst which is dstlen bits long
+void appendbits(struct stepbits *dst, int16_t dstlen, struct stepbits *src, int16_t len) {
+  for (int16_t i=0; i < len; ++i) if (testbit(src,i)) setbit(dst,dstlen+i);
+}
+
+// euclidean pattern of k hits spread over n steps, rotated right by rotate steps
+// gives the same patterns as the euclidean rows in drumpatterns.h eg k=5 n=16 is 1001001001001000
+void euclid(struct stepbits *out, int16_t k, int16_t n, int16_t rotate) {
+  struct stepbits a,b,t;  // hit string, rest string, scratch
+  int16_t alen=1, blen=1, acount=k, bcount=n-k;
+
+  clearbits(out);
+  if ((n <= 0) || (k <= 0)) return;
+  if (n > MAX_STEPS) n=MAX_STEPS;
+  if (k > n) k=n;
+  bcount=n-k;
+  clearbits(&a); setbit(&a,0);  // "1"
+  clearbits(&b);                // "0"
+  while (bcount > 1) {
+    int16_t m=min(acount,bcount);
+    int16_t tlen=alen+blen;
+    t=a;                          // a+b becomes the new hit string
+    appendbits(&t,alen,&b,blen);
+    if (acount > bcount) {        // leftover hit strings become the rest strings
+      b=a; blen=alen; bcount=acount-m;
+    }
+    else bcount=bcount-m;         // leftover rest strings stay as they are
+    a=t; alen=tlen; acount=m;
+  }
+  struct stepbits pat;            // acount hit strings followed by bcount rest strings
+  int16_t len=0;
+  clearbits(&pat);
+  for (int16_t i=0; i < acount; ++i) { appendbits(&pat,len,&a,alen); len+=alen; }
+  for (int16_t i=0; i < bcount; ++i) { appendbits(&pat,len,&b,blen); len+=blen; }
+  rotate=((rotate % n) + n) % n;
+  for (int16_t i=0; i < n; ++i) if (testbit(&pat,i)) setbit(out,(i+rotate) % n);
+}
+
+// nested euclidean layer - spreads k hits evenly over the hits of an existing pattern of n steps
+// used for accents so they always land on steps that play
+void euclidnest(struct stepbits *out, struct stepbits *base, int16_t n, int16_t k) {
+  struct stepbits layer;
+  int16_t hits=0;
+  for (int16_t i=0; i < n; ++i) if (testbit(base,i)) ++hits;
+  euclid(&layer,k,hits,0);
+  clearbits(out);
+  for (int16_t i=0, h=0; i < n; ++i) {
+    if (testbit(base,i)) {
+      if (testbit(&layer,h)) setbit(out,i);
+      ++h;
+    }
+  }
+}
+
+// work out the euclidean fill and accents for track t
+// called when the fill settings or the track length change so the sequencer interrupt only has to test a bit
+void makefill(int16_t t) {
+  euclid(&fillbits[t],patfill[t],steps[t],patshift[t]);
+  euclidnest(&accentbits[t],&fillbits[t],steps[t],pataccent[t]);
+}
+
+// pattern generator output for step n of track t
+// returns true if the step triggers and sets the note pitch and velocity
+// used to fill clips in makepattern() and by generative tracks which call it from the sequencer callback at every step
+// *** generative tracks call this in the interrupt so keep it quick
+bool genstep(int16_t t, int16_t n, uint8_t *pitch, uint8_t *velocity) {
+  uint16_t pat=rightRotate(patshift[t],drumpatterns[pattern[t]],STEPS_PER_BAR); // rotate the pattern per the menu setting
+  bool hit=(pat & (0x8000 >> (n % STEPS_PER_BAR))) !=0; // pattern repeats every bar
+  bool accent=testbit(&accentbits[t],n);
+  if (testbit(&fillbits[t],n)) hit=true; // add euclidean fill over the whole clip length
+  if (!hit) return false;
+  if (voice[t].slices !=0) *pitch=MIDDLE_C+pitchoffset(t,n); // insert slice number
+  else *pitch=padtoMIDI[current_scale][pitchremap[pitchoffset(t,n)]]; // else insert note from current scale
+  *velocity=DEFAULT_LEVEL+velocityoffset(t,n);
+  if (accent) *velocity=min(*velocity+ACCENT_LEVEL,127);
+  return true;
+}
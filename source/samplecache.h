@@ -0,0 +1,153 @@
+// converted sample cache on the SD card
+// the first time a .wav file is loaded the 16 bit mono SAMPLERATE samples are also written to a file in CACHE_DIR
+// after that the sample loads with big straight reads into PSRAM - no parsing, converting or resampling
+// cache files are named from a hash of the source path and the header holds the path, size and modify time of the source
+// if any of them don't match the cache entry is stale so the .wav is converted again and the entry rewritten
+
+#define CACHE_DIR "/Cache"
+#define CACHE_MAGIC 0x31434247  // "GBC1"
+#define CACHE_VERSION 1         // bump if the header or the conversion changes so old entries are rebuilt
+#define CACHE_HEADER SD_SECTOR  // the header fills a sector so the samples after it are sector aligned
+#define CACHE_BLOCK 32768       // bytes per read of a cache file - big aligned reads go straight from the card to PSRAM
+
+// cache file header - padded to CACHE_HEADER bytes by the path
+struct cacheheader {
+  uint32_t magic;       // only written once the file is complete so a half written entry is never used
+  uint32_t version;
+  uint32_t rate;        // SAMPLERATE the samples were converted to
+  uint32_t length;      // samples
+  uint32_t srcsize;     // size and FAT modify date/time of the source .wav
+  uint16_t srcdate;
+  uint16_t srctime;
+  int16_t peak;         // biggest sample magnitude
+  uint16_t reserved;
+  char path[CACHE_HEADER-28]; // source path - so a hash collision can't load the wrong sample
+} cachehdr;
+
+FsFile cache;
+bool cachewriting=false; // a cache entry is being written alongside a .wav load
+uint32_t cachedone;      // samples read from or written to the cache file
+int16_t *cachebuf;       // where cached samples are read to
+char cachepath[32];      // name of the cache file for the current load
+
+// FNV-1a hash of a path
+uint32_t pathhash(char *path) {
+  uint32_t h=0x811C9DC5;
+  for (char *p=path; *p; ++p) h=(h ^ (uint8_t)*p)*0x01000193;
+  return h;
+}
+
+// cache file name for a source path
+void cachename(char *path) {
+  sprintf(cachepath,"%s/%08lX.SMP",CACHE_DIR,(unsigned long)pathhash(path));
+}
+
+// look for an up to date cache entry for the .wav file opened by wavopen()
+// returns true and leaves the cache file open at the start of the samples if there is one
+bool cacheopen(char *path) {
+  cachename(path);
+  cache=sd.open(cachepath);
+  if (!cache) return false;
+  if ((cache.read(&cachehdr,CACHE_HEADER) == CACHE_HEADER) && (cachehdr.magic == CACHE_MAGIC) && (cachehdr.version == CACHE_VERSION)
+    && (cachehdr.rate == SAMPLERATE) && (cachehdr.length == wav.length) && (cachehdr.srcsize == wav.filesize)
+    && (cachehdr.srcdate == wav.date) && (cachehdr.srctime == wav.time) && (strncmp(cachehdr.path,path,sizeof(cachehdr.path)) == 0)
+    && (cache.fileSize() >= CACHE_HEADER+cachehdr.length*2)) return true;
+#ifdef DEBUG
+  Serial.printf("cache entry %s for %s is stale\n",cachepath,path);
+#endif
+  cache.close();
+  return false;
+}
+
+// start reading the cache entry found by cacheopen() into buf
+void cachebegin(int16_t *buf) {
+  cachebuf=buf;
+  cachedone=0;
+}
+
+// read the next block of samples from the cache
+// returns true when all the samples are read or the read fails - cachedone is the number of samples read
+bool cacheread(void) {
+  uint32_t n=min((uint32_t)CACHE_BLOCK,(cachehdr.length-cachedone)*2);
+  if ((n == 0) || (cache.read(cachebuf+cachedone,n) != (int)n)) {
+    cache.close();
+    return true;
+  }
+  cachedone+=n/2;
+  return false;
+}
+
+// how far the cache read has got in %
+int16_t cacheprogress(void) {
+  if (cachehdr.length == 0) return 100;
+  return (uint64_t)cachedone*100/cachehdr.length;
+}
+
+// start writing a cache entry for the .wav file opened by wavopen()
+// files that are already 16 bit mono at SAMPLERATE load just as fast without one so they aren't cached
+void cachecreate(char *path) {
+  cachewriting=false;
+  if ((wav.channels == 1) && (wav.bits == 16) && !rs.on) return;
+  cachename(path);
+  if (!sd.exists(CACHE_DIR)) sd.mkdir(CACHE_DIR);
+  cache=sd.open(cachepath,O_WRONLY | O_CREAT | O_TRUNC);
+  if (!cache) return;
+  memset(&cachehdr,0,sizeof(cachehdr));  // no magic till its finished
+  if (cache.write(&cachehdr,CACHE_HEADER) != CACHE_HEADER) {
+    cache.close();
+    sd.remove(cachepath);
+    return;
+  }
+  strncpy(cachehdr.path,path,sizeof(cachehdr.path)-1);
+  cachedone=0;
+  cachewriting=true;
+}
+
+// throw away a cache entry that didn't get finished
+void cacheabort(void) {
+  if (!cachewriting) return;
+  cache.close();
+  sd.remove(cachepath);
+  cachewriting=false;
+}
+
+// add n converted samples to the cache entry being written
+void cachewrite(int16_t *src, uint32_t n) {
+  if (!cachewriting || (n == 0)) return;
+  int32_t peak=cachehdr.peak;
+  for (uint32_t i=0; i < n; ++i) if (abs(src[i]) > peak) peak=abs(src[i]);
+  cachehdr.peak=min(peak,(int32_t)32767);
+  if (cache.write(src,n*2) != n*2) {  // card full or write protected - just load without caching
+#ifdef DEBUG
+    Serial.printf("cache write to %s failed\n",cachepath);
+#endif
+    cacheabort();
+    return;
+  }
+  cachedone+=n;
+}
+
+// finish the cache entry once the whole .wav is converted
+void cachefinish(void) {
+  if (!cachewriting) return;
+  if (cachedone != wav.length) {
+    cacheabort();
+    return;
+  }
+  cachehdr.magic=CACHE_MAGIC;
+  cachehdr.version=CACHE_VERSION;
+  cachehdr.rate=SAMPLERATE;
+  cachehdr.length=cachedone;
+  cachehdr.srcsize=wav.filesize;
+  cachehdr.srcdate=wav.date;
+  cachehdr.srctime=wav.time;
+  if (!cache.seekSet(0) || (cache.write(&cachehdr,CACHE_HEADER) != CACHE_HEADER)) {
+    cacheabort();
+    return;
+  }
+  cache.close();
+  cachewriting=false;
+#ifdef DEBUG
+  Serial.printf("cached %d samples in %s\n",cachedone,cachepath);
+#endif
+}
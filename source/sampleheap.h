@@ -0,0 +1,168 @@
+// PSRAM sample heap
+// pmalloc() rounds every sample up to PMALLOC_CHUNK and loading and freeing samples fragments PSRAM over a session
+// so PSRAM is taken in one block at startup and samples are allocated from it here, only rounded up to HEAP_ALIGN bytes
+// blocks are kept in a table sorted by address and allocation is first fit
+// compaction slides the samples down to the bottom of the heap so all the free space ends up in one piece
+// it is done a slice at a time from loop() like loading so a few MB of moves don't stall the pads and the UI
+// each block knows which sample[] it belongs to so the sample pointer can be moved with it
+// core1 doesn't read a sample while it is being moved - core0 sets heappause and waits for core1 to copy it to heappaused
+// notes on it keep their place and carry on when it is back so they only drop out for the move
+
+#define HEAP_ALIGN 16                 // block size and address rounding
+#define HEAP_BLOCKS NUM_SAMPLES       // a block for every sample in the pool
+#define HEAP_RESERVE PMALLOC_CHUNK    // PSRAM left for pmalloc()
+#define HEAP_NO_OWNER -1              // block isn't on a track yet eg a sample being loaded
+#define HEAP_SLICE_MICROS 2000        // max time loop() spends compacting each time around
+#define HEAP_MOVE_CHUNK 16384         // bytes moved between checks of the time
+
+struct heapblock {
+  uint32_t offset;      // from heapbase
+  uint32_t size;        // bytes
+  int16_t owner;        // sample[] index
+};
+
+struct heapblock heapblocks[HEAP_BLOCKS];  // in address order
+int16_t heapcount=0;
+uint8_t *heapbase;
+uint32_t heapsize=0;
+
+volatile int16_t heappause=HEAP_NO_OWNER;  // sample being moved - core1 mustn't read it
+volatile int16_t heappaused=HEAP_NO_OWNER; // core1's copy of heappause - set at the start of every loop1()
+
+// compaction in progress
+struct heapcompactor {
+  bool busy;
+  int16_t block;        // block being moved
+  uint32_t top;         // where it goes
+  uint32_t moved;       // bytes of it moved so far
+} heapmove;
+
+// memory view in the setup menu
+int16_t memfree;        // KB
+int16_t memused;        // KB
+int16_t memfrag;        // % of the free space that isn't in the biggest free block
+int16_t defrag=0;       // menu control - turn to Go to compact the heap
+
+// work out the numbers for the memory view
+void heapstats(void) {
+  uint32_t top=0, unused=0, largest=0;
+  for (int16_t i=0; i <= heapcount; ++i) {
+    uint32_t end=(i < heapcount) ? heapblocks[i].offset : heapsize;
+    uint32_t gap=end-top;
+    unused+=gap;
+    if (gap > largest) largest=gap;
+    if (i < heapcount) top=heapblocks[i].offset+heapblocks[i].size;
+  }
+  memfree=unused/1024;
+  memused=(heapsize-unused)/1024;
+  memfrag=(unused == 0) ? 0 : 100-(uint64_t)largest*100/unused;
+}
+
+// take PSRAM for the heap - as much as pmalloc() will give less HEAP_RESERVE
+void heapinit(void) {
+  for (heapsize=PSRAM_SIZE-HEAP_RESERVE; heapsize >= PMALLOC_CHUNK; heapsize-=PMALLOC_CHUNK) {
+    heapbase=(uint8_t *)pmalloc(heapsize);
+    if (heapbase != 0) break;
+  }
+  if (heapbase == 0) heapsize=0;
+#ifdef DEBUG
+  Serial.printf("sample heap %d bytes at %x\n",heapsize,heapbase);
+#endif
+  heapcount=0;
+  heapstats();
+}
+
+// allocate bytes from the heap
+// returns 0 if there isn't a big enough free block - compacting the heap may make room
+void * heapalloc(uint32_t bytes) {
+  uint32_t size=(bytes+HEAP_ALIGN-1) & ~(HEAP_ALIGN-1);
+  uint32_t top=0;
+  int16_t i;
+  if ((heapcount >= HEAP_BLOCKS) || (size == 0) || heapmove.busy) return 0;
+  for (i=0; i < heapcount; ++i) {  // first gap that fits
+    if (heapblocks[i].offset-top >= size) break;
+    top=heapblocks[i].offset+heapblocks[i].size;
+  }
+  if ((i == heapcount) && (heapsize-top < size)) return 0;
+  memmove(&heapblocks[i+1],&heapblocks[i],(heapcount-i)*sizeof(struct heapblock));
+  heapblocks[i].offset=top;
+  heapblocks[i].size=size;
+  heapblocks[i].owner=HEAP_NO_OWNER;
+  ++heapcount;
+  heapstats();
+  return heapbase+top;
+}
+
+// block index of a heap pointer or -1
+int16_t heapfind(void *p) {
+  for (int16_t i=0; i < heapcount; ++i) if (heapbase+heapblocks[i].offset == (uint8_t *)p) return i;
+  return -1;
+}
+
+// give a block back to the heap
+void heapfree(void *p) {
+  int16_t i=heapfind(p);
+  if (i < 0) return;
+  --heapcount;
+  memmove(&heapblocks[i],&heapblocks[i+1],(heapcount-i)*sizeof(struct heapblock));
+  heapstats();
+}
+
+// set the sample[] a block belongs to so compaction can move the sample pointer
+void heapown(void *p, int16_t owner) {
+  int16_t i=heapfind(p);
+  if (i >= 0) heapblocks[i].owner=owner;
+}
+
+// start sliding every block down to the bottom of the heap - heapservice() does the work
+// blocks with no owner would be left with a stale pointer so don't start this while a sample is loading
+// nothing can be allocated or freed till it is done
+void heapcompactstart(void) {
+  heapmove.busy=true;
+  heapmove.block=0;
+  heapmove.top=0;
+  heapmove.moved=0;
+}
+
+// true while a compaction is running
+bool heapcompacting(void) {
+  return heapmove.busy;
+}
+
+// do the next slice of the compaction started by heapcompactstart()
+// called from loop() - a block is moved HEAP_MOVE_CHUNK bytes at a time so it can be left half moved till next time
+// the copy is always down the heap so each chunk only overwrites what has been moved already
+void heapservice(void) {
+  if (!heapmove.busy) return;
+  uint32_t start=micros();
+  while (heapmove.block < heapcount) {
+    struct heapblock *b=&heapblocks[heapmove.block];
+    int16_t owner=b->owner;
+    if (b->offset != heapmove.top) {
+      if ((heapmove.moved == 0) && (owner != HEAP_NO_OWNER)) {
+        heappause=owner;
+        while (heappaused != owner);  // wait till core1 has stopped reading it
+      }
+      while (heapmove.moved < b->size) {
+        if ((micros()-start) >= HEAP_SLICE_MICROS) return;  // the sample stays paused till the next slice
+        uint32_t n=min(b->size-heapmove.moved,(uint32_t)HEAP_MOVE_CHUNK);
+        memmove(heapbase+heapmove.top+heapmove.moved,heapbase+b->offset+heapmove.moved,n);
+        heapmove.moved+=n;
+      }
+      b->offset=heapmove.top;
+      if (owner != HEAP_NO_OWNER) {
+        sample[owner].samplearray=(int16_t *)(heapbase+heapmove.top);
+        __sync_synchronize();  // new pointer is in place before core1 can read the sample again
+        heappause=HEAP_NO_OWNER;
+      }
+    }
+    heapmove.top+=b->size;
+    heapmove.moved=0;
+    ++heapmove.block;
+  }
+  heapmove.busy=false;
+  heapstats();
+#ifdef DEBUG
+  Serial.printf("heap compacted - %d KB free\n",memfree);
+#endif
+}
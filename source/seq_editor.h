@@ -5,17 +5,21 @@
 void showpattern(uint8_t track) {
   float xstep=160.0/(float)(steps[track]); // how wide 1 step is on the screen
   SixteenStepNote *note;
+  uint8_t pitch,velocity;
   int16_t y;
   uint16_t velcolor;
   display.fillRect(0,17,160,23,BLACK); // erase old 
   for (int i=0; i<steps[track];++i ) {
     note=seq[track].getNote(i,(scene <<4 | track));
-    if (note->pitch !=0) {
-      y=(int) note->pitch-MIDDLE_C;  // all pitches are centered on middle C 
+    pitch=note->pitch;
+    velocity=note->velocity;
+    if ((pitch == 0) && (patmode[track] == PATMODE_GEN)) genstep(track,i,&pitch,&velocity); // show what a generative track will play
+    if (pitch !=0) {
+      y=(int) pitch-MIDDLE_C;  // all pitches are centered on middle C 
  //     velcolor=note->velocity <<9;  // map velocity to color
  //     velcolor=((note->velocity <<9) & 0xf000) | 0x0800;  // map velocity to color red
  //     velcolor|=((note->velocity <<5) & 0x0e00); // add some green
-      velcolor=vcolors[map(note->velocity,0,127,0,sizeof(vcolors)/sizeof(uint16_t))]; // map velocity using color table
+      velcolor=vcolors[map(velocity,0,127,0,sizeof(vcolors)/sizeof(uint16_t))]; // map velocity using color table
       y=PIANO_ROLL_Y-y/2; // flip so notes go up with pitch
       display.drawRect((int)(i*xstep), y,(int)xstep,2, velcolor);
     }
@@ -38,6 +42,26 @@ enum editstates{INIT_EDITOR,SELECTNOTE,EDITNOTE}; // editor state machine states
 static int16_t editstate=INIT_EDITOR;
 static int16_t editcursorX;
 static uint8_t editnote;
+static uint8_t edittrig;  // trig of the note being edited so it shows in showposition()
+static uint8_t editratchet;  // ratchet of the note being edited
+static uint8_t editlock;  // sample lock of the note being edited
+
+// short names of the trig conditions for the display
+const char *trignames[]={"ALL ","FILL","!FIL","PRE ","!PRE","1ST ","!1ST","1:2 ","2:2 ","1:3 ","2:3 ","3:3 ","1:4 ","2:4 ","3:4 ","4:4 "};
+const char ratchetcurves[]={' ','+','-'}; // even, faster, slower
+
+// ratchet settings in the order the encoder steps through them - off, then 2-8 repeats for each spacing curve
+#define RATCHET_SETTINGS (1+7*3)
+
+uint8_t ratchetsetting(uint8_t n) {
+  if (n == 0) return 0;
+  return FS_RATCHET((n-1)%7+2,(n-1)/7);
+}
+
+uint8_t ratchetindex(uint8_t ratchet) {
+  if (ratchet == 0) return 0;
+  return FS_RATCHET_CURVE(ratchet)*7+FS_RATCHET_COUNT(ratchet)-1;
+}
 
 // note editor - a run to completion state machine very similar to the menu system
 // it does loop while waiting for encoder button release on state changes
@@ -55,6 +79,9 @@ void editnotes(void) {
       draweditcursor(editcursorX,GREEN);
       noteptr=seq[track].getNote(editcursorX,(scene <<4 | track)); // fetch note from this step so it displays correctly in showposition()
       editnote=note=noteptr->pitch;
+      edittrig=noteptr->trig;
+      editratchet=noteptr->ratchet;
+      editlock=noteptr->sample;
       showpattern(track);  // show whats there
       editstate=SELECTNOTE;
       break;
@@ -67,6 +94,9 @@ void editnotes(void) {
         draweditcursor(editcursorX,GREEN);
         noteptr=seq[track].getNote(editcursorX,(scene <<4 | track)); // fetch note from this step so it displays correctly in showposition()
         editnote=note=noteptr->pitch;
+        edittrig=noteptr->trig;
+        editratchet=noteptr->ratchet;
+        editlock=noteptr->sample;
         showpattern(track);  // show whats there
       }
       if (!digitalRead(ENC_SW)) {
@@ -82,7 +112,30 @@ void editnotes(void) {
       }
     break;
     case EDITNOTE:  // rotate encoder to change note - changed this so if you scroll off the bottom or the top there is more than one click (NOTE_DEADZONE) that removes the note
-      if (enc !=0) {
+      if ((enc !=0) && (editnote !=0) && shiftkey && (currtouched & TRACK_BUTTON)) { // shift + track + encoder sets the sample lock
+        editlock=constrain(editlock+enc,0,LOCK_SLOTS);
+        undoclip(track,scene);
+        seq[track].setSample(editcursorX,(scene <<4 | track),editlock);
+        undoend();
+      }
+      else if ((enc !=0) && (editnote !=0) && (shiftkey || (currtouched & SCENE_BUTTON))) { // shift + encoder sets the chance, scene + encoder sets the condition
+        int16_t skip=FS_TRIG_SKIP(edittrig);
+        int16_t condition=FS_TRIG_CONDITION(edittrig);
+        if (shiftkey) skip=constrain(skip-enc,0,15);  // turning right makes the note more likely
+        else condition=constrain(condition+enc,FS_TRIG_ALWAYS,FS_TRIG_4_4);
+        edittrig=FS_TRIG(condition,skip);
+        undoclip(track,scene);
+        seq[track].setTrig(editcursorX,(scene <<4 | track),edittrig);
+        undoend();
+      }
+      else if ((enc !=0) && (editnote !=0) && (currtouched & TRACK_BUTTON)) { // track + encoder sets the ratchet
+        int16_t n=constrain(ratchetindex(editratchet)+enc,0,RATCHET_SETTINGS-1);
+        editratchet=ratchetsetting(n);
+        undoclip(track,scene);
+        seq[track].setRatchet(editcursorX,(scene <<4 | track),editratchet);
+        undoend();
+      }
+      else if (enc !=0) {
         noteptr=seq[track].getNote(editcursorX,(scene <<4 | track)); // *** something very weird happening - note pointer getting trashed? had to recode this with editnote variable
         if (note !=0) {
           note+=enc;
@@ -92,6 +145,7 @@ void editnotes(void) {
         else {
           note = MIDDLE_C; // turns note back on
         }
+        undoclip(track,scene); // edits are one undo step until something else changes the clip
         seq[track].removeNote(editcursorX,(scene <<4 | track)); // remove any note at this position
          //  if note is in valid range, save it
         if ((note >=LOWEST_NOTE) && (note <= HIGHEST_NOTE)) {          
@@ -99,6 +153,10 @@ void editnotes(void) {
           editnote=note; // so it shows in showpattern()
         }
         else editnote=0; // out of range so turn it off for showpattern()
+        edittrig=0;  // new note always plays once
+        editratchet=0;
+        editlock=0;
+        undoend();
         showpattern(track);
       }
       if (!digitalRead(ENC_SW)) {
@@ -0,0 +1,218 @@
+// master transport and song timeline
+// one clock for the whole groovebox counted in ticks - 24 ticks per 16th note step ie 96 per quarter note
+// the timer interrupt calls transportrun() which catches up on any ticks that are due
+// tick times come from the microsecond timer and the remainder of the tick period is carried forward so there is no drift at any tempo
+// every track sequencer is clocked from the same ticks so they can't drift apart
+
+#define TICKS_PER_STEP 24
+#define TICKS_PER_BEAT (TICKS_PER_STEP*4)
+// track step divisions - each track's sequencer advances every so many master ticks so all divisions stay locked to the bar
+enum divisions{DIV_4,DIV_8,DIV_8T,DIV_16,DIV_16T,DIV_32,DIV_32T,NDIVISIONS};
+const int16_t divisionticks[NDIVISIONS]={96,48,32,24,16,12,8};
+
+// time signatures - a bar is timesigbeats notes of 1/timesigunit
+#define NTIMESIGS 9
+const int8_t timesigbeats[NTIMESIGS]={4,3,5,7,2,6,7,9,12};
+const int8_t timesigunit[NTIMESIGS]={4,4,4,4,4,8,8,8,8};
+
+#define MAX_SCENE_REPEATS 16
+#define MAX_SCENE_BARS 16
+#define SONG_MAX_BARS (NSCENES*MAX_SCENE_REPEATS*MAX_SCENE_BARS)
+
+volatile bool transportrunning=false;
+volatile uint32_t tickcount=0;  // ticks since the transport started
+uint32_t nexttick;              // micros() time of the next tick
+uint32_t tickmicros;            // whole microseconds per tick
+uint32_t tickremainder;         // left over part of the tick period - carried forward in tickfraction
+uint32_t tickfraction;
+uint32_t tickdivisor;           // bpm * ticks per beat
+uint32_t tickdue;               // micros() time the tick being run was due
+
+// the song chain is compiled to a list of the scene to play in every bar of the song
+// so the transport just looks up the next bar and we can start the song from any bar
+uint8_t songtimeline[SONG_MAX_BARS];
+int16_t songlength=1;           // bars in the song
+volatile int16_t songbar=0;     // bar of the song that is playing
+
+// clip launching
+// each track plays its own scene so clips can be launched and stopped one track at a time
+// launches are queued and the transport starts them on the next step, beat or bar so they are always in time
+#define LAUNCH_NONE -1              // nothing queued
+#define CLIP_STOPPED -2             // track is stopped or queued to stop
+enum launchquantizes{LAUNCH_STEP,LAUNCH_BEAT,LAUNCH_BAR};
+volatile int8_t playscene[NTRACKS]={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}; // scene each track is playing
+volatile int8_t launchqueue[NTRACKS]={-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1}; // scene queued on each track
+volatile bool launchpending=false;
+int16_t launchquantize=LAUNCH_BAR;  // set in the setup menu
+
+// live recording
+// the pads are scanned from loop() so a note is always a little late by the time we see it
+// the scan is timestamped and RECORD_LATENCY_US covers the time from touching a pad to the scan seeing it
+#define RECORD_LATENCY_US 4000  // MPR121 filtering + half the loop() time - adjust to taste
+int16_t recquantize=100;        // record quantize strength in % - set in the setup menu
+
+// number of ticks since a micros() timestamp including the latency compensation
+int16_t ticksago(uint32_t stamp) {
+  return ((micros()-stamp) + RECORD_LATENCY_US + tickmicros/2) / tickmicros;
+}
+
+// sample delay for a note played by the transport
+// the timer interrupt only runs every ENC_TIMER_MICROS so ticks run up to that late
+// every sequenced note is delayed by one interrupt period less how late its tick ran so the voices start exactly on the tick
+// *** runs in the timer interrupt
+uint16_t notedelay(void) {
+  uint32_t late=micros()-tickdue;
+  if (late >= ENC_TIMER_MICROS) return 0;
+  return ((ENC_TIMER_MICROS-late)*SAMPLERATE)/1000000;
+}
+
+// ticks per step of track t
+int16_t trackticks(int16_t t) {
+  return divisionticks[division[t]];
+}
+
+// ticks per bar and per beat of the time signature
+int16_t barticks(void) {
+  return TICKS_PER_STEP*stepsperbar;
+}
+
+int16_t beatticks(void) {
+  return TICKS_PER_STEP*16/timesigunit[timesig];
+}
+
+// set the scene track t is playing - CLIP_STOPPED stops it
+// the sequencer only plays that scene's notes so trig conditions and chances only follow the clip we hear
+void setplayscene(int16_t t, int16_t s) {
+  playscene[t]=s;
+  seq[t].setPlayChannel(s == CLIP_STOPPED ? FS_NO_CHANNEL : (s <<4 | t));
+}
+
+// set the tick period from the tempo
+void settransporttempo(int16_t tempo) {
+  noInterrupts();
+  tickdivisor=tempo*TICKS_PER_BEAT;
+  tickmicros=60000000/tickdivisor;
+  tickremainder=60000000%tickdivisor;
+  tickfraction=0;
+  interrupts();
+}
+
+// start the transport from tick 0 - first tick is right away
+void transportstart(void) {
+  tickcount=0;
+  tickfraction=0;
+  nexttick=micros();
+  transportrunning=true;
+}
+
+void transportstop(void) {
+  transportrunning=false;
+}
+
+// build the song timeline from the scene repeats and bar lengths in the song menu
+// menu callback so it is done when the song is edited, not while it plays
+void compilesong(void) {
+  int16_t n=0;
+  noInterrupts();
+  for (int16_t s=0; s < NSCENES; ++s) {
+    for (int16_t r=0; r < scenecount[s]; ++r) {
+      for (int16_t b=0; b < scenebars[s]; ++b) songtimeline[n++]=s;
+    }
+  }
+  if (n == 0) songtimeline[n++]=0; // always something to play
+  songlength=n;
+  if (songbar >= songlength) songbar=0;
+  interrupts();
+}
+
+// jump to a bar of the song
+void songseek(int16_t bar) {
+  noInterrupts();
+  songbar=bar % songlength;
+  scene=songtimeline[songbar];
+  for (int16_t t=0; t < NTRACKS; ++t) setplayscene(t,scene);
+  interrupts();
+}
+
+// next bar of the song - called by the transport on the bar line
+// when the scene changes all the clips restart so the new scene starts on its first step
+void songadvance(void) {
+  if (++songbar >= songlength) songbar=0;
+  int16_t s=songtimeline[songbar];
+  if (s != scene) {
+    scene=s;
+    for (int16_t t=0; t < NTRACKS; ++t) {
+      setplayscene(t,s);
+      seq[t].start();
+    }
+  }
+}
+
+// number of ticks between launch points
+int16_t launchticks(void) {
+  switch (launchquantize) {
+    case LAUNCH_STEP:
+      return TICKS_PER_STEP;
+    case LAUNCH_BEAT:
+      return beatticks();
+    default:
+      return barticks();
+  }
+}
+
+// start any queued clips - called on every tick but only does something on a launch point
+// the launched clip restarts so its first step plays right on the launch point
+// *** runs in the timer interrupt
+void servicelaunches(void) {
+  if (!launchpending || ((tickcount % launchticks()) != 0)) return;
+  for (int16_t t=0; t < NTRACKS; ++t) {
+    if (launchqueue[t] == LAUNCH_NONE) continue;
+    setplayscene(t,launchqueue[t]);
+    launchqueue[t]=LAUNCH_NONE;
+    seq[t].start();
+  }
+  launchpending=false;
+}
+
+// queue scene s (or CLIP_STOPPED) on track t
+// if the transport is stopped there is nothing to wait for so it happens right away
+void launchclip(int16_t t, int16_t s) {
+  noInterrupts();
+  if (transportrunning) {
+    launchqueue[t]=s;
+    launchpending=true;
+  }
+  else setplayscene(t,s);
+  interrupts();
+}
+
+// queue a whole row of clips
+void launchscene(int16_t s) {
+  for (int16_t t=0; t < NTRACKS; ++t) launchclip(t,s);
+}
+
+// one transport tick
+// *** runs in the timer interrupt
+void transporttick(void) {
+  if (song_mode && (tickcount !=0) && ((tickcount % barticks()) == 0)) songadvance(); // scene changes exactly on the bar line
+  servicelaunches();
+  for (sequencer=0; sequencer< NTRACKS; ++sequencer) seq[sequencer].tick();
+  ++tickcount;
+}
+
+// run any ticks that are due
+// *** runs in the timer interrupt
+void transportrun(void) {
+  if (!transportrunning) return;
+  uint32_t now=micros();
+  while ((int32_t)(now-nexttick) >= 0) {
+    tickdue=nexttick;
+    transporttick();
+    nexttick+=tickmicros;
+    tickfraction+=tickremainder;
+    if (tickfraction >= tickdivisor) {
+      tickfraction-=tickdivisor;
+      ++nexttick;
+    }
+  }
+}
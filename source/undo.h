@@ -0,0 +1,197 @@
+// clip snapshots for undo/redo and copy/paste
+// a snapshot is a packed copy of the notes in one clip - only the steps that have notes are stored
+// snapshots are never changed once they are made so the undo history and the clipboard can share them
+// each one has a reference count and is freed when the last user lets go of it
+// each track remembers its last snapshot and the sequencer version it was taken at
+// if the clip hasn't been written since, the same snapshot is handed out again instead of making a copy
+
+#define UNDO_LEVELS 128     // max number of clip snapshots in the undo history
+#define UNDO_MEMORY 16384   // max bytes of snapshot memory before the oldest undo steps are dropped
+
+struct clipsnap {
+  uint16_t refs;            // number of users of this snapshot
+  uint16_t length;          // clip length in steps when the snapshot was taken
+  uint16_t count;           // number of notes stored
+  uint16_t size;            // bytes used by this snapshot
+  SixteenStepNote *notes;   // notes follow the header in the same block
+};
+
+struct undoentry {
+  uint16_t group;           // clips changed by the same edit have the same group and are undone together
+  uint8_t track;
+  uint8_t scene;
+  uint32_t version;         // sequencer version after the edit - used to merge repeated edits into one undo step
+  struct clipsnap *snap;    // clip before the edit
+};
+
+struct undoentry undostack[UNDO_LEVELS]; // ring buffer - oldest entries are dropped when it fills
+int16_t undobottom=0;       // index of oldest undo entry
+int16_t undocount=0;
+struct undoentry redostack[UNDO_LEVELS];
+int16_t redocount=0;
+uint16_t undogroup=0;       // group number of the edit in progress
+uint16_t undokeep=0;        // group that is being worked on - never dropped to make room
+uint32_t undomemory=0;      // bytes used by all snapshots
+
+struct clipsnap *lastsnap[NTRACKS];  // last snapshot taken of each track
+uint8_t lastsnapscene[NTRACKS];
+uint32_t lastsnapversion[NTRACKS];
+
+SixteenStepNote snapbuffer[MAX_STEPS];   // clips are unpacked here so callers can build the new clip in patternbuffer while saving the old one
+struct clipsnap *copiedclip=0;           // clipboard for clip copy/paste
+struct clipsnap *copiedscene[NTRACKS];   // clipboard for scene copy/paste
+
+// let go of a snapshot - frees it when nobody is using it
+void releasesnap(struct clipsnap *snap) {
+  if (snap == 0) return;
+  if (--snap->refs > 0) return;
+  undomemory-=snap->size;
+  free(snap);
+}
+
+// drop the oldest undo step to free up snapshot memory
+// returns false if there is nothing that can be dropped
+bool dropundo(void) {
+  if (undocount == 0) return false;
+  uint16_t group=undostack[undobottom].group;
+  if (group == undokeep) return false;
+  while ((undocount > 0) && (undostack[undobottom].group == group)) {
+    releasesnap(undostack[undobottom].snap);
+    undobottom=(undobottom+1) % UNDO_LEVELS;
+    --undocount;
+  }
+  return true;
+}
+
+// get a snapshot of clip t,sc
+// shares the last snapshot of the track if the clip hasn't changed since
+struct clipsnap * takesnap(int16_t t, int16_t sc) {
+  uint32_t version=seq[t].getVersion();
+  if ((lastsnap[t] != 0) && (lastsnapscene[t] == sc) && (lastsnapversion[t] == version)) {
+    ++lastsnap[t]->refs;
+    return lastsnap[t];
+  }
+  seq[t].getClip(sc <<4 | t,snapbuffer,steps[t]);
+  uint16_t count=0;
+  for (int n=0; n < steps[t]; ++n) if (snapbuffer[n].pitch !=0) ++count;
+  uint16_t size=sizeof(struct clipsnap)+count*sizeof(SixteenStepNote);
+  while ((undomemory+size > UNDO_MEMORY) && dropundo()); // make room
+  struct clipsnap *snap=(struct clipsnap *)malloc(size);
+  if (snap == 0) return 0;
+  snap->refs=1;
+  snap->length=steps[t];
+  snap->count=count;
+  snap->size=size;
+  snap->notes=(SixteenStepNote *)(snap+1);
+  count=0;
+  for (int n=0; n < steps[t]; ++n) if (snapbuffer[n].pitch !=0) snap->notes[count++]=snapbuffer[n];
+  undomemory+=size;
+  releasesnap(lastsnap[t]);  // remember this one in case we are asked again
+  lastsnap[t]=snap;
+  ++snap->refs;
+  lastsnapscene[t]=sc;
+  lastsnapversion[t]=version;
+  return snap;
+}
+
+// unpack a snapshot into a clip buffer indexed by step
+void expandsnap(struct clipsnap *snap, SixteenStepNote *clip) {
+  for (int n=0; n < snap->length; ++n) clip[n]=DEFAULT_NOTE;
+  for (int n=0; n < snap->count; ++n) clip[snap->notes[n].step]=snap->notes[n];
+}
+
+// write a snapshot back to clip t,sc
+void putsnap(int16_t t, int16_t sc, struct clipsnap *snap) {
+  expandsnap(snap,snapbuffer);
+  seq[t].pasteClip(sc <<4 | t,snapbuffer,snap->length);
+  releasesnap(lastsnap[t]);  // the clip is the same as the snapshot now
+  lastsnap[t]=snap;
+  ++snap->refs;
+  lastsnapscene[t]=sc;
+  lastsnapversion[t]=seq[t].getVersion();
+}
+
+// start a new undo step - clips saved until the next undobegin() are undone together
+// any new edit throws away the redo history
+void undobegin(void) {
+  undokeep=++undogroup;
+  while (redocount > 0) releasesnap(redostack[--redocount].snap);
+}
+
+// save clip t,sc in the undo step in progress
+void undosave(int16_t t, int16_t sc) {
+  struct clipsnap *snap=takesnap(t,sc);
+  if (snap == 0) return;  // out of memory - edit can't be undone
+  if ((undocount == UNDO_LEVELS) && !dropundo()) { // no room left in this undo step
+    releasesnap(snap);
+    return;
+  }
+  struct undoentry *e=&undostack[(undobottom+undocount) % UNDO_LEVELS];
+  e->group=undogroup;
+  e->track=t;
+  e->scene=sc;
+  e->version=0;
+  e->snap=snap;
+  ++undocount;
+}
+
+// finish the undo step in progress - call after the clips have been changed
+void undoend(void) {
+  for (int i=undocount-1; i >= 0; --i) {
+    struct undoentry *e=&undostack[(undobottom+i) % UNDO_LEVELS];
+    if (e->group != undogroup) break;
+    e->version=seq[e->track].getVersion();
+  }
+}
+
+// save clip t,sc before an edit
+// repeated edits to the same clip eg recording notes or turning a pattern knob are merged into one undo step
+// as long as nothing else has written to the clip in between
+void undoclip(int16_t t, int16_t sc) {
+  if (undocount > 0) {
+    struct undoentry *e=&undostack[(undobottom+undocount-1) % UNDO_LEVELS];
+    if ((e->group == undogroup) && (e->track == t) && (e->scene == sc) && (e->version == seq[t].getVersion())) return;
+  }
+  undobegin();
+  undosave(t,sc);
+}
+
+// move the top step from one stack to the other, swapping the saved clips with the ones in the sequencer
+void undoswap(struct undoentry *from, int16_t *fromcount, struct undoentry *to, int16_t *tocount, bool fromring) {
+  if (*fromcount == 0) return;
+  uint16_t group=from[fromring ? (undobottom+*fromcount-1) % UNDO_LEVELS : *fromcount-1].group;
+  undokeep=group;
+  while (*fromcount > 0) {
+    struct undoentry *e=&from[fromring ? (undobottom+*fromcount-1) % UNDO_LEVELS : *fromcount-1];
+    if (e->group != group) break;
+    struct clipsnap *now=takesnap(e->track,e->scene); // current clip goes on the other stack
+    putsnap(e->track,e->scene,e->snap);
+    if ((now != 0) && (*tocount == UNDO_LEVELS) && (fromring || !dropundo())) { // other stack is full
+      releasesnap(now);
+      now=0;
+    }
+    if (now != 0) {
+      struct undoentry *d=&to[fromring ? *tocount : (undobottom+*tocount) % UNDO_LEVELS];
+      d->group=group;
+      d->track=e->track;
+      d->scene=e->scene;
+      d->snap=now;
+      d->version=0;
+      ++*tocount;
+    }
+    releasesnap(e->snap);
+    --*fromcount;
+  }
+}
+
+// undo the last edit
+void undo(void) {
+  undoswap(undostack,&undocount,redostack,&redocount,true);
+  ++undogroup;  // don't merge the next edit into an undone step
+}
+
+// redo the last undone edit
+void redo(void) {
+  undoswap(redostack,&redocount,undostack,&undocount,false);
+  ++undogroup;
+}
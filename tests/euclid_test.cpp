@@ -0,0 +1,128 @@
+// host test for the euclidean generator in source/patterngen.h - no Arduino needed
+// cd tests && g++ -o euclid_test euclid_test.cpp && ./euclid_test
+// checks euclid() against the euclidean rows of drumpatterns.h for n=16, rotation, and that euclidnest() only lands on hits
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+using std::min;
+
+// just enough of the sketch for patterngen.h to compile
+#define NTRACKS 16
+#define MAX_STEPS 128
+#define STEPS_PER_BAR 16
+#define MIDDLE_C 60
+#define DEFAULT_LEVEL 64
+#define constrain(x,lo,hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+int16_t patpitch[NTRACKS], patvelocity[NTRACKS], patfill[NTRACKS], patshift[NTRACKS], pattern[NTRACKS], steps[NTRACKS];
+int16_t current_scale;
+uint8_t padtoMIDI[1][16], pitchremap[16];
+struct { int16_t slices; } voice[NTRACKS];
+uint16_t rightRotate(int16_t shift, uint16_t value, int16_t bits) { return (value >> shift) | (value << (bits-shift)); }
+
+#include "../source/drumpatterns.h"
+#include "../source/patterngen.h"
+
+int failures=0;
+
+void fail(const char *what, int16_t k, int16_t n, int16_t rotate) {
+  printf("FAIL %s k=%d n=%d rotate=%d\n",what,k,n,rotate);
+  ++failures;
+}
+
+int16_t countbits(struct stepbits *b, int16_t n) {
+  int16_t c=0;
+  for (int16_t i=0; i < n; ++i) if (testbit(b,i)) ++c;
+  return c;
+}
+
+// the euclidean rows of drumpatterns.h are the ones commented "Euclidean <k> beat(s)" - k=0 is the empty pattern
+// read from the source so the test follows the table if rows are added
+bool euclidrows(uint16_t row[17]) {
+  FILE *f=fopen("../source/drumpatterns.h","r");  // run from the tests directory
+  if (f == 0) return false;
+  char line[200];
+  int16_t index=0;
+  bool found[17]={false};
+  while (fgets(line,sizeof(line),f)) {
+    if (strncmp(line,"0b",2) != 0) continue;
+    int k;
+    char *e=strstr(line,"Euclidean ");
+    if ((e != 0) && (sscanf(e,"Euclidean %d",&k) == 1) && (k >= 1) && (k <= 16)) {
+      row[k]=drumpatterns[index];
+      found[k]=true;
+    }
+    ++index;
+  }
+  fclose(f);
+  row[0]=drumpatterns[0];
+  for (int16_t k=1; k <= 16; ++k) if (!found[k]) return false;
+  return true;
+}
+
+int main(void) {
+  uint16_t row[17];
+  if (!euclidrows(row)) {
+    printf("FAIL can't find the euclidean rows in drumpatterns.h\n");
+    return 1;
+  }
+
+  // n=16 matches the table - bit 15 of a table row is step 0
+  for (int16_t k=0; k <= 16; ++k) {
+    struct stepbits b;
+    euclid(&b,k,16,0);
+    uint16_t pat=0;
+    for (int16_t i=0; i < 16; ++i) if (testbit(&b,i)) pat|=0x8000 >> i;
+    if (pat != row[k]) fail("table",k,16,0);
+  }
+
+  // every length: k hits, rotation moves every hit right by rotate steps
+  for (int16_t n=1; n <= MAX_STEPS; ++n) {
+    for (int16_t k=0; k <= n; ++k) {
+      struct stepbits b, r;
+      euclid(&b,k,n,0);
+      if (countbits(&b,n) != k) fail("hit count",k,n,0);
+      if ((k > 0) && !testbit(&b,0)) fail("first step",k,n,0);
+      for (int16_t rotate=-n; rotate <= 2*n; rotate+=(n < 8) ? 1 : n/7) {
+        euclid(&r,k,n,rotate);
+        int16_t shift=((rotate % n)+n) % n;
+        for (int16_t i=0; i < n; ++i) {
+          if (testbit(&b,i) != testbit(&r,(i+shift) % n)) {
+            fail("rotation",k,n,rotate);
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  // nested layer: k hits, all on hits of the base pattern
+  for (int16_t n=1; n <= MAX_STEPS; n+=(n < 32) ? 1 : 7) {
+    for (int16_t fill=0; fill <= n; fill+=(n < 32) ? 1 : 5) {
+      struct stepbits base;
+      euclid(&base,fill,n,n/3);
+      for (int16_t k=0; k <= fill+2; ++k) {
+        struct stepbits nest;
+        euclidnest(&nest,&base,n,k);
+        if (countbits(&nest,n) != min(k,fill)) fail("nested hit count",k,n,fill);
+        for (int16_t i=0; i < n; ++i) {
+          if (testbit(&nest,i) && !testbit(&base,i)) {
+            fail("nested hit off the base",k,n,fill);
+            break;
+          }
+        }
+        for (int16_t i=n; i < MAX_STEPS; ++i) {
+          if (testbit(&nest,i)) {
+            fail("nested hit past the end",k,n,fill);
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  if (failures == 0) printf("euclid ok\n");
+  return failures != 0;
+}
@@ -0,0 +1,44 @@
+// just enough of Arduino and SdFat on the host for the sketch's loader code - see wav_bench.cpp and resample_sweep.cpp
+// FsFile is stdio underneath and counts the SD operations so the loaders can be compared
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <sys/time.h>
+
+using std::min;
+using std::max;
+
+#define SAMPLERATE 22050
+#define PI 3.14159265358979f
+#define constrain(x,lo,hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+
+uint32_t micros(void) {
+  timeval t;
+  gettimeofday(&t,0);
+  return t.tv_sec*1000000+t.tv_usec;
+}
+
+struct { void printf(const char *, ...) {} } Serial;
+
+uint32_t reads, seeks, opens;  // SD operations
+
+struct FsFile {
+  FILE *f=0;
+  int read(void) { ++reads; return fgetc(f); }
+  int read(void *buf, size_t n) { ++reads; return fread(buf,1,n,f); }
+  bool seekCur(int64_t offset) { ++seeks; return fseek(f,offset,SEEK_CUR) == 0; }
+  bool seekSet(uint64_t offset) { ++seeks; return fseek(f,offset,SEEK_SET) == 0; }
+  uint64_t curPosition(void) { return ftell(f); }
+  uint64_t fileSize(void) { long p=ftell(f); fseek(f,0,SEEK_END); long s=ftell(f); fseek(f,p,SEEK_SET); return s; }
+  bool getModifyDateTime(uint16_t *date, uint16_t *time) { *date=*time=0; return true; }
+  bool close(void) { if (f) fclose(f); f=0; return true; }
+  operator bool() { return f != 0; }
+};
+
+struct {
+  FsFile open(const char *path) { FsFile file; ++opens; file.f=fopen(path,"rb"); return file; }
+} sd;
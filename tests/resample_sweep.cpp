@@ -0,0 +1,101 @@
+// host sweep of the resampler in source/loadwav.h - no Arduino needed
+// loads sine tones at every input rate the loader accepts and measures what comes out at SAMPLERATE
+// cd tests && g++ -O2 -o resample_sweep resample_sweep.cpp && ./resample_sweep
+//
+// for each input rate it reports
+// - passband: gain range for tones up to PASS_EDGE of the lower of the two rates
+// - snr: worst ratio of the tone to everything else in the output for those tones - noise, distortion and aliases
+// - alias: worst output level for tones that can't be represented at SAMPLERATE ie above SAMPLERATE/2 - all of it is aliasing
+// levels are dB relative to the input tone
+// fails if any alias is above ALIAS_LIMIT
+
+#include "host.h"
+#include "../source/loadwav.h"
+
+#define PASS_EDGE 0.3         // fraction of SAMPLERATE that must be flat
+#define ALIAS_LIMIT -60.0     // worst alias allowed in dB
+#define TONE_LEVEL 16384      // -6dBFS
+#define TONE_SECONDS 0.25
+#define SWEEP_PATH "/tmp/resample_sweep.wav"
+
+int16_t out[0x100000+2];
+
+// write a mono 16 bit .wav file of a sine at f Hz
+void tonewav(uint32_t rate, double f, uint32_t frames) {
+  FILE *file=fopen(SWEEP_PATH,"wb");
+  uint32_t datasize=frames*2, u32;
+  uint16_t u16;
+  fwrite("RIFF",1,4,file); u32=4+8+16+8+datasize; fwrite(&u32,4,1,file); fwrite("WAVE",1,4,file);
+  fwrite("fmt ",1,4,file); u32=16; fwrite(&u32,4,1,file);
+  u16=1; fwrite(&u16,2,1,file); fwrite(&u16,2,1,file); fwrite(&rate,4,1,file);
+  u32=rate*2; fwrite(&u32,4,1,file); u16=2; fwrite(&u16,2,1,file); u16=16; fwrite(&u16,2,1,file);
+  fwrite("data",1,4,file); fwrite(&datasize,4,1,file);
+  for (uint32_t i=0; i < frames; ++i) {
+    int16_t x=lrint(TONE_LEVEL*sin(2*M_PI*f*i/rate));
+    fwrite(&x,2,1,file);
+  }
+  fclose(file);
+}
+
+// level of the tone at f in the middle of the output and the rms of everything else, both in dB relative to the input tone
+// least squares fit of a sine and cosine at f - the rest is what the fit leaves
+void measure(int32_t n, double f, double *gain, double *rest) {
+  int32_t from=n/5, to=n-n/5;  // skip the filter edges
+  double cc=0, cs=0, ss=0, xc=0, xs=0, xx=0;
+  for (int32_t i=from; i < to; ++i) {
+    double c=cos(2*M_PI*f*i/SAMPLERATE), s=sin(2*M_PI*f*i/SAMPLERATE), x=out[i];
+    cc+=c*c; cs+=c*s; ss+=s*s;
+    xc+=x*c; xs+=x*s; xx+=x*x;
+  }
+  double det=cc*ss-cs*cs, a=0, b=0;
+  if (fabs(det) > 1e-9*cc*ss) {
+    a=(xc*ss-xs*cs)/det;
+    b=(xs*cc-xc*cs)/det;
+  }
+  int32_t len=to-from;
+  double residual=(xx-a*xc-b*xs)/len;
+  double inputpower=(double)TONE_LEVEL*TONE_LEVEL/2;
+  *gain=20*log10(max(sqrt(a*a+b*b),1e-3)/TONE_LEVEL);
+  *rest=10*log10(max(residual,1e-3)/inputpower);
+}
+
+int main(void) {
+  const uint32_t rates[]={8000,11025,16000,32000,44100,48000,88200,96000,176400,192000};
+  bool ok=true;
+  printf("%7s %20s %9s %9s\n","rate","passband dB","snr dB","alias dB");
+  for (uint32_t rate : rates) {
+    double gmin=0, gmax=-200, snr=200, alias=-200, aliasf=0;
+    double top=rate/2.0*0.98;
+    for (int t=1; t <= 200; ++t) {
+      double f=top*t/200;
+      tonewav(rate,f,rate*TONE_SECONDS);
+      int32_t n=wavopen((char *)SWEEP_PATH);
+      if ((n <= 0) || (n > 0x100000)) {
+        printf("%u Hz can't be loaded\n",rate);
+        return 1;
+      }
+      n=wavload(out);
+      double gain, rest;
+      if (f <= min(rate,(uint32_t)SAMPLERATE)*PASS_EDGE) {
+        measure(n,f,&gain,&rest);
+        gmin=(gmin == 0) ? gain : min(gmin,gain);
+        gmax=max(gmax,gain);
+        snr=min(snr,gain-rest);
+      }
+      else if (f >= SAMPLERATE/2.0) {
+        measure(n,0,&gain,&rest);  // everything is alias
+        double level=rest;
+        if (level > alias) {
+          alias=level;
+          aliasf=f;
+        }
+      }
+    }
+    if (alias > ALIAS_LIMIT) ok=false;
+    if (alias > -200) printf("%7u %9.2f to %7.2f %9.1f %9.1f at %.0f Hz\n",rate,gmin,gmax,snr,alias,aliasf);
+    else printf("%7u %9.2f to %7.2f %9.1f %9s\n",rate,gmin,gmax,snr,"-");
+  }
+  remove(SWEEP_PATH);
+  printf(ok ? "sweep ok\n" : "FAIL aliases above %.0f dB\n",ALIAS_LIMIT);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+// host benchmark for the .wav loader in source/loadwav.h - no Arduino needed
+// loads every file in a corpus and reports MB/s of .wav data plus the number of SD reads, seeks and opens it took
+// cd tests && g++ -O2 -o wav_bench wav_bench.cpp && ./wav_bench -g corpus && ./wav_bench corpus/*.wav
+//
+// to compare with the old byte at a time loader get the loadwav.h from before the rewrite and build with OLD_LOADER
+// git show 742cb29^:source/loadwav.h > old_loadwav.h && g++ -O2 -DOLD_LOADER -o old_bench wav_bench.cpp && ./old_bench corpus/*.wav
+//
+// the files come from the host's page cache so MB/s here is the CPU cost of the loader, not the speed of an SD card
+// the read and seek counts are what matter on the card - each FsFile::read() call costs about the same however little it reads
+
+#include "host.h"
+
+#ifdef OLD_LOADER
+#include "old_loadwav.h"
+#else
+#include "../source/loadwav.h"
+#endif
+
+// write a test .wav file - a mix of tones with a short extra chunk before the data like many editors add
+void makewav(const char *path, uint16_t channels, uint16_t bits, uint32_t rate, uint32_t frames) {
+  FILE *f=fopen(path,"wb");
+  uint16_t framesize=channels*bits/8;
+  uint32_t datasize=frames*framesize;
+  uint32_t u32;
+  uint16_t u16;
+  fwrite("RIFF",1,4,f); u32=4+8+16+8+6+8+datasize; fwrite(&u32,4,1,f); fwrite("WAVE",1,4,f);
+  fwrite("fmt ",1,4,f); u32=16; fwrite(&u32,4,1,f);
+  u16=1; fwrite(&u16,2,1,f); fwrite(&channels,2,1,f); fwrite(&rate,4,1,f);
+  u32=rate*framesize; fwrite(&u32,4,1,f); fwrite(&framesize,2,1,f); fwrite(&bits,2,1,f);
+  fwrite("LIST",1,4,f); u32=6; fwrite(&u32,4,1,f); fwrite("INFOab",1,6,f);
+  fwrite("data",1,4,f); fwrite(&datasize,4,1,f);
+  for (uint32_t i=0; i < frames; ++i) {
+    for (uint16_t c=0; c < channels; ++c) {
+      int32_t x=(int32_t)(8000*sin(2*M_PI*220*(c+1)*i/rate)+4000*sin(2*M_PI*3100*i/rate)) << (bits-16);
+      fwrite(&x,bits/8,1,f);
+    }
+  }
+  fclose(f);
+}
+
+// a corpus of 5 second files in the formats people load
+void makecorpus(const char *dir) {
+  const uint32_t rates[]={22050,44100,48000,96000};
+  char path[300];
+  for (uint32_t rate : rates) {
+    for (uint16_t channels=1; channels <= 2; ++channels) {
+      for (uint16_t bits=16; bits <= 24; bits+=8) {
+        snprintf(path,sizeof(path),"%s/%u_%s_%u.wav",dir,rate,channels == 1 ? "mono" : "stereo",bits);
+        makewav(path,channels,bits,rate,rate*5);
+      }
+    }
+  }
+}
+
+int16_t samples[0x100000+2];
+
+int main(int argc, char **argv) {
+  if ((argc == 3) && (strcmp(argv[1],"-g") == 0)) {
+    char cmd[300];
+    snprintf(cmd,sizeof(cmd),"mkdir -p %s",argv[2]);
+    if (system(cmd) != 0) return 1;
+    makecorpus(argv[2]);
+    return 0;
+  }
+  if (argc < 2) {
+    printf("usage: wav_bench -g <dir> to make a corpus, wav_bench <files> to load them\n");
+    return 1;
+  }
+  uint64_t bytes=0, us=0;
+  for (int i=1; i < argc; ++i) {
+    FILE *f=fopen(argv[i],"rb");
+    if (f == 0) continue;
+    fseek(f,0,SEEK_END);
+    uint32_t size=ftell(f);
+    fclose(f);
+    uint32_t r=reads, s=seeks, o=opens;
+    uint32_t start=micros();
+#ifdef OLD_LOADER
+    int32_t n=loadwav(argv[i],0);  // the old loader was called once for the size and again to load
+    if ((n > 0) && (n <= 0x100000)) n=loadwav(argv[i],(uint8_t *)samples);
+    in.close();
+#else
+    int32_t n=wavopen(argv[i]);
+    if ((n > 0) && (n <= 0x100000)) n=wavload(samples);
+    else wavclose();
+#endif
+    uint32_t t=micros()-start;
+    bytes+=size;
+    us+=t;
+    printf("%-40s %8u bytes %8d samples %7u us %7.1f MB/s %7u reads %3u seeks %u opens\n",argv[i],size,n,t,t ? size/(double)t : 0,reads-r,seeks-s,opens-o);
+  }
+  printf("total %llu bytes in %llu us - %.1f MB/s, %u reads, %u seeks, %u opens\n",(unsigned long long)bytes,(unsigned long long)us,us ? bytes/(double)us : 0,reads,seeks,opens);
+  return 0;
+}